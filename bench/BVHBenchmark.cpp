@@ -0,0 +1,293 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <filesystem>
+#include "cyTriMesh.h"
+#include "MeshBVH.h"
+
+/* Triangle soup with three corners per face */
+struct TriangleList
+{
+    std::vector<cy::Vec3f> corners;
+    cy::Vec3f boundMin;
+    cy::Vec3f boundMax;
+
+    size_t TriangleCount() const { return corners.size() / 3; }
+};
+
+/* Wavy grid with roughly faceCount triangles folded into a closed box so rays from every direction hit it */
+TriangleList makeSyntheticMesh(unsigned int faceCount)
+{
+    unsigned int quadsPerSide = std::max(1u, static_cast<unsigned int>(std::sqrt(faceCount / 12.0)));
+    TriangleList mesh;
+    mesh.corners.reserve(static_cast<size_t>(quadsPerSide)*quadsPerSide*6*6);
+    for (int side = 0; side < 6; side++)
+    {
+        int axis = side / 2;
+        float sign = side % 2 ? -1.0f : 1.0f;
+        auto point = [&](unsigned int x, unsigned int y)
+        {
+            float u = 2.0f*x/quadsPerSide - 1.0f;
+            float v = 2.0f*y/quadsPerSide - 1.0f;
+            float height = sign*(1.0f + 0.05f*std::sin(u*17.0f)*std::cos(v*13.0f));
+            cy::Vec3f position;
+            position[axis] = height;
+            position[(axis + 1) % 3] = u;
+            position[(axis + 2) % 3] = v;
+            return position;
+        };
+        for (unsigned int y = 0; y < quadsPerSide; y++)
+        {
+            for (unsigned int x = 0; x < quadsPerSide; x++)
+            {
+                cy::Vec3f a = point(x, y), b = point(x + 1, y), c = point(x, y + 1), d = point(x + 1, y + 1);
+                mesh.corners.insert(mesh.corners.end(), { a, b, d, a, d, c });
+            }
+        }
+    }
+    mesh.boundMin = cy::Vec3f(-1.05f);
+    mesh.boundMax = cy::Vec3f(1.05f);
+    return mesh;
+}
+
+bool loadObjMesh(const std::filesystem::path& objPath, TriangleList& mesh)
+{
+    cy::TriMesh triMesh;
+    if (!triMesh.LoadFromFileObj(objPath.string().c_str(), false, nullptr)) { return false; }
+    triMesh.ComputeBoundingBox();
+    mesh.boundMin = triMesh.GetBoundMin();
+    mesh.boundMax = triMesh.GetBoundMax();
+    mesh.corners.resize(static_cast<size_t>(triMesh.NF())*3);
+    for (unsigned int face = 0; face < triMesh.NF(); face++)
+    {
+        for (int corner = 0; corner < 3; corner++) { mesh.corners[face*3 + corner] = triMesh.V(triMesh.F(face).v[corner]); }
+    }
+    return true;
+}
+
+struct Ray
+{
+    cy::Vec3f origin;
+    cy::Vec3f direction;
+};
+
+/* Rays from a sphere around the mesh toward random points inside its bounding box */
+std::vector<Ray> makeRays(const TriangleList& mesh, size_t rayCount)
+{
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    cy::Vec3f center = (mesh.boundMin + mesh.boundMax) / 2;
+    cy::Vec3f extent = mesh.boundMax - mesh.boundMin;
+    float radius = extent.Length();
+    std::vector<Ray> rays(rayCount);
+    for (Ray& ray : rays)
+    {
+        float z = 2.0f*unit(random) - 1.0f;
+        float angle = 2.0f*cy::Pi<float>()*unit(random);
+        float ringRadius = std::sqrt(1.0f - z*z);
+        ray.origin = center + radius*cy::Vec3f(ringRadius*std::cos(angle), ringRadius*std::sin(angle), z);
+        cy::Vec3f target = mesh.boundMin + cy::Vec3f(unit(random)*extent.x, unit(random)*extent.y, unit(random)*extent.z);
+        ray.direction = target - ray.origin;
+    }
+    return rays;
+}
+
+/* Trace every ray on numThreads threads and return the rays per second and the number of hits */
+template <typename Query>
+double traceRays(const std::vector<Ray>& rays, unsigned int numThreads, Query query, size_t& hitCount)
+{
+    std::vector<size_t> threadHits(numThreads, 0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < numThreads; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            size_t end = rays.size()*(t + 1)/numThreads;
+            for (size_t i = rays.size()*t/numThreads; i < end; i++) { threadHits[t] += query(rays[i]) ? 1 : 0; }
+        });
+    }
+    for (std::thread& thread : threads) { thread.join(); }
+    auto end = std::chrono::steady_clock::now();
+    hitCount = 0;
+    for (size_t hits : threadHits) { hitCount += hits; }
+    return rays.size() / std::chrono::duration<double>(end - start).count();
+}
+
+/* Reference ray triangle test, written independently of the one in MeshBVH */
+bool intersectReference(const Ray& ray, const cy::Vec3f& a, const cy::Vec3f& b, const cy::Vec3f& c, float& t)
+{
+    cy::Vec3f normal = (b - a).Cross(c - a);
+    float denominator = normal.Dot(ray.direction);
+    if (denominator == 0.0f) { return false; }
+    t = normal.Dot(a - ray.origin) / denominator;
+    if (!(t > 0.0f)) { return false; }
+    cy::Vec3f point = ray.origin + t*ray.direction;
+    return (b - a).Cross(point - a).Dot(normal) >= 0.0f && (c - b).Cross(point - b).Dot(normal) >= 0.0f && (a - c).Cross(point - c).Dot(normal) >= 0.0f;
+}
+
+/* Compare the BVH against testing every triangle on the first rays. Rays grazing an edge may legitimately disagree, so only the distance is compared. */
+bool matchesBruteForce(const MeshBVH& bvh, const TriangleList& mesh, const std::vector<Ray>& rays, size_t checkCount)
+{
+    size_t mismatches = 0;
+    for (size_t r = 0; r < std::min(checkCount, rays.size()); r++)
+    {
+        const Ray& ray = rays[r];
+        float closest = std::numeric_limits<float>::max();
+        for (size_t face = 0; face < mesh.TriangleCount(); face++)
+        {
+            float t;
+            if (intersectReference(ray, mesh.corners[face*3], mesh.corners[face*3 + 1], mesh.corners[face*3 + 2], t)) { closest = std::min(closest, t); }
+        }
+        RayHit hit;
+        bool found = bvh.IntersectClosest(ray.origin, ray.direction, hit);
+        bool expected = closest != std::numeric_limits<float>::max();
+        bool matches = found == expected && bvh.IntersectAny(ray.origin, ray.direction) == expected
+            && (!found || std::abs(hit.t - closest) <= 1e-4f*std::max(1.0f, closest));
+        mismatches += matches ? 0 : 1;
+    }
+    return mismatches == 0;
+}
+
+/* The surface of an integer cube split into unit squares, cast at with rays along the axes whose other coordinates lie on the integer
+   and half integer planes, so many rays run exactly in the plane of a node bound and the hits at edges and corners compute exactly */
+bool matchesBruteForceAxisParallel(unsigned int cubeSize)
+{
+    TriangleList mesh;
+    float size = static_cast<float>(cubeSize);
+    for (int side = 0; side < 6; side++)
+    {
+        int axis = side / 2;
+        for (unsigned int y = 0; y < cubeSize; y++)
+        {
+            for (unsigned int x = 0; x < cubeSize; x++)
+            {
+                auto point = [&](unsigned int u, unsigned int v)
+                {
+                    cy::Vec3f position;
+                    position[axis] = side % 2 ? 0.0f : size;
+                    position[(axis + 1) % 3] = static_cast<float>(u);
+                    position[(axis + 2) % 3] = static_cast<float>(v);
+                    return position;
+                };
+                cy::Vec3f a = point(x, y), b = point(x + 1, y), c = point(x, y + 1), d = point(x + 1, y + 1);
+                mesh.corners.insert(mesh.corners.end(), { a, b, d, a, d, c });
+            }
+        }
+    }
+    mesh.boundMin = cy::Vec3f(0.0f);
+    mesh.boundMax = cy::Vec3f(size);
+
+    std::vector<Ray> rays;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        for (unsigned int v = 0; v <= 2*cubeSize; v++)
+        {
+            for (unsigned int u = 0; u <= 2*cubeSize; u++)
+            {
+                for (float sign : { 1.0f, -1.0f })
+                {
+                    Ray ray;
+                    ray.origin[axis] = sign > 0.0f ? -1.0f : size + 1.0f;
+                    ray.origin[(axis + 1) % 3] = u / 2.0f;
+                    ray.origin[(axis + 2) % 3] = v / 2.0f;
+                    ray.direction = cy::Vec3f(0.0f);
+                    ray.direction[axis] = sign;
+                    rays.push_back(ray);
+                }
+            }
+        }
+    }
+
+    auto corner = [&](size_t face, int i) { return mesh.corners[face*3 + i]; };
+    MeshBVH bvh;
+    bvh.Build(mesh.TriangleCount(), corner, 1);
+    bool matches = matchesBruteForce(bvh, mesh, rays, rays.size());
+    printf("axis parallel rays: %zu rays along the node planes of a %u cube %s brute force\n", rays.size(), cubeSize, matches ? "match" : "DIFFER from");
+    return matches;
+}
+
+bool benchmarkMesh(const std::string& name, const TriangleList& mesh, size_t rayCount, unsigned int numThreads, size_t checkCount)
+{
+    auto corner = [&](size_t face, int i) { return mesh.corners[face*3 + i]; };
+    MeshBVH bvh;
+    double buildSeconds[2] = {};
+    unsigned int buildThreads[2] = { 1, numThreads };
+    for (int b = 0; b < 2; b++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bvh.Build(mesh.TriangleCount(), corner, buildThreads[b]);
+        auto end = std::chrono::steady_clock::now();
+        buildSeconds[b] = std::chrono::duration<double>(end - start).count();
+    }
+    printf("%s: %zu triangles, %zu nodes\n", name.c_str(), mesh.TriangleCount(), bvh.NodeCount());
+    printf("  build    1 thread   %8.3f s  %8.2f Mtris/s\n", buildSeconds[0], mesh.TriangleCount() / buildSeconds[0] / 1e6);
+    printf("  build  %3u threads  %8.3f s  %8.2f Mtris/s  (%.2fx)\n", numThreads, buildSeconds[1], mesh.TriangleCount() / buildSeconds[1] / 1e6, buildSeconds[0] / buildSeconds[1]);
+
+    std::vector<Ray> rays = makeRays(mesh, rayCount);
+    auto closest = [&](const Ray& ray) { RayHit hit; return bvh.IntersectClosest(ray.origin, ray.direction, hit); };
+    auto any = [&](const Ray& ray) { return bvh.IntersectAny(ray.origin, ray.direction); };
+    for (unsigned int threads : { 1u, numThreads })
+    {
+        size_t closestHits = 0;
+        size_t anyHits = 0;
+        double closestRate = traceRays(rays, threads, closest, closestHits);
+        double anyRate = traceRays(rays, threads, any, anyHits);
+        printf("  rays   %3u threads  closest-hit %8.2f Mrays/s  any-hit %8.2f Mrays/s  (%.1f%% hit)\n",
+               threads, closestRate / 1e6, anyRate / 1e6, 100.0 * closestHits / rays.size());
+        if (closestHits != anyHits) { return false; }
+    }
+
+    bool matches = matchesBruteForce(bvh, mesh, rays, checkCount);
+    printf("  first %zu rays %s brute force\n", std::min(checkCount, rays.size()), matches ? "match" : "DIFFER from");
+    return matches;
+}
+
+int main(int argc, char** argv)
+{
+    /* Parse Command Line Arguements */
+    std::vector<unsigned int> faceCounts;
+    std::vector<std::filesystem::path> objPaths;
+    size_t rayCount = 1000000;
+    size_t checkCount = 200;
+    unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--rays" && i + 1 < argc) { rayCount = std::strtoull(argv[++i], nullptr, 10); }
+        else if (arg == "--check" && i + 1 < argc) { checkCount = std::strtoull(argv[++i], nullptr, 10); }
+        else if (arg == "--threads" && i + 1 < argc) { numThreads = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--obj" && i + 1 < argc) { objPaths.push_back(argv[++i]); }
+        else if (arg[0] != '-') { faceCounts.push_back(static_cast<unsigned int>(std::strtoul(argv[i], nullptr, 10))); }
+        else
+        {
+            std::cerr << "Usage: BVHBenchmark [faceCount...] [--obj path]... [--rays N] [--threads N] [--check N]" << std::endl;
+            return -1;
+        }
+    }
+    if (faceCounts.empty() && objPaths.empty()) { faceCounts = { 100000, 1000000, 4000000 }; }
+
+    bool allMatch = matchesBruteForceAxisParallel(8);
+    for (const std::filesystem::path& objPath : objPaths)
+    {
+        TriangleList mesh;
+        if (!loadObjMesh(objPath, mesh))
+        {
+            std::cerr << "Could not load mesh from obj file at path: " << objPath << std::endl;
+            return -1;
+        }
+        allMatch = benchmarkMesh(objPath.string(), mesh, rayCount, numThreads, checkCount) && allMatch;
+    }
+    for (unsigned int faceCount : faceCounts)
+    {
+        TriangleList mesh = makeSyntheticMesh(faceCount);
+        allMatch = benchmarkMesh("synthetic " + std::to_string(faceCount), mesh, rayCount, numThreads, std::min<size_t>(checkCount, 20)) && allMatch;
+    }
+    return allMatch ? 0 : 1;
+}
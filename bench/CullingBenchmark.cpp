@@ -0,0 +1,165 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include "cyMatrix.h"
+#include "FrustumCuller.h"
+
+/* Boxes of random sizes scattered through a cube, like the instances of a large scene */
+CullBounds makeBounds(size_t objectCount, float sceneSize)
+{
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> position(-sceneSize/2, sceneSize/2);
+    std::uniform_real_distribution<float> extent(0.25f, 2.5f);
+    CullBounds bounds;
+    bounds.Reserve(objectCount);
+    for (size_t i = 0; i < objectCount; i++)
+    {
+        bounds.Add(cy::Vec3f(position(random), position(random), position(random)), cy::Vec3f(extent(random), extent(random), extent(random)));
+    }
+    return bounds;
+}
+
+/* Cameras inside the scene looking in random directions */
+std::vector<cy::Matrix4f> makeCameras(size_t cameraCount, float sceneSize, float fovRadians, float aspect, std::vector<cy::Vec3f>& positions)
+{
+    std::mt19937 random(54321);
+    std::uniform_real_distribution<float> position(-sceneSize/4, sceneSize/4);
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    cy::Matrix4f projection = cy::Matrix4f::Perspective(fovRadians, aspect, 0.1f, sceneSize/2);
+    std::vector<cy::Matrix4f> viewProjections;
+    positions.clear();
+    for (size_t c = 0; c < cameraCount; c++)
+    {
+        cy::Vec3f eye(position(random), position(random), position(random));
+        cy::Vec3f forward(direction(random), direction(random), direction(random));
+        if (forward.LengthSquared() < 1e-4f) { forward = cy::Vec3f(0, 0, -1); }
+        cy::Matrix4f view;
+        view.SetView(eye, eye + forward, std::abs(forward.GetNormalized().y) > 0.99f ? cy::Vec3f(1, 0, 0) : cy::Vec3f(0, 1, 0));
+        viewProjections.push_back(projection * view);
+        positions.push_back(eye);
+    }
+    return viewProjections;
+}
+
+/* A box with a corner inside the clip volume has to be kept, whatever test is used.
+   Corners within float precision of a plane may go either way, far plane depths in particular are rounded heavily, so only clearly inside corners count. */
+bool hasCornerInside(const cy::Matrix4f& viewProjection, const CullBounds& bounds, size_t i)
+{
+    for (int corner = 0; corner < 8; corner++)
+    {
+        cy::Vec3f offset((corner & 1 ? 1.0f : -1.0f)*bounds.extentX[i], (corner & 2 ? 1.0f : -1.0f)*bounds.extentY[i], (corner & 4 ? 1.0f : -1.0f)*bounds.extentZ[i]);
+        cy::Vec4f clip = viewProjection * cy::Vec4f(cy::Vec3f(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]) + offset, 1.0f);
+        float inside = 0.999f*clip.w;
+        if (std::abs(clip.x) <= inside && std::abs(clip.y) <= inside && std::abs(clip.z) <= inside) { return true; }
+    }
+    return false;
+}
+
+/* Cull against every camera and return the objects per second, with the result of every camera */
+template <typename CullFunc>
+double cullCameras(const CullBounds& bounds, const std::vector<cy::Matrix4f>& viewProjections, const std::vector<cy::Vec3f>& positions, LODSelection lod,
+                   CullFunc cull, std::vector<CullResult>& results)
+{
+    results.resize(viewProjections.size());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < viewProjections.size(); c++)
+    {
+        lod.cameraPosition = positions[c];
+        cull(bounds, Frustum::FromViewProjection(viewProjections[c]), lod, results[c]);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return static_cast<double>(bounds.Count())*viewProjections.size() / std::chrono::duration<double>(end - start).count();
+}
+
+bool sameResults(const std::vector<CullResult>& a, const std::vector<CullResult>& b)
+{
+    if (a.size() != b.size()) { return false; }
+    for (size_t c = 0; c < a.size(); c++)
+    {
+        if (a[c].levels != b[c].levels) { return false; }
+    }
+    return true;
+}
+
+bool benchmarkBounds(size_t objectCount, size_t cameraCount, unsigned int numThreads, size_t checkCount)
+{
+    const float sceneSize = 1000.0f;
+    const float fovRadians = 75.0f*cy::Pi<float>()/180.0f;
+    CullBounds bounds = makeBounds(objectCount, sceneSize);
+    std::vector<cy::Vec3f> positions;
+    std::vector<cy::Matrix4f> viewProjections = makeCameras(cameraCount, sceneSize, fovRadians, 1280.0f/960.0f, positions);
+    LODSelection lod;
+    lod.pixelsPerUnit = LODSelection::PixelsPerUnit(fovRadians, 960);
+    lod.screenSizes = { 256.0f, 64.0f, 16.0f };
+
+    std::vector<CullResult> scalarResults, serialResults, parallelResults;
+    double scalarRate = cullCameras(bounds, viewProjections, positions, lod, FrustumCuller::CullScalar, scalarResults);
+    FrustumCuller serialCuller(1);
+    double serialRate = cullCameras(bounds, viewProjections, positions, lod,
+        [&](const CullBounds& b, const Frustum& f, const LODSelection& l, CullResult& r) { serialCuller.Cull(b, f, l, r); }, serialResults);
+    FrustumCuller parallelCuller(numThreads);
+    double parallelRate = cullCameras(bounds, viewProjections, positions, lod,
+        [&](const CullBounds& b, const Frustum& f, const LODSelection& l, CullResult& r) { parallelCuller.Cull(b, f, l, r); }, parallelResults);
+
+    size_t visible = 0;
+    for (const CullResult& result : scalarResults) { visible += result.VisibleCount(); }
+    printf("%zu objects, %zu cameras, %.1f%% visible\n", objectCount, cameraCount, 100.0*visible / (static_cast<double>(objectCount)*cameraCount));
+    printf("  scalar          1 thread   %8.2f Mobjects/s\n", scalarRate / 1e6);
+#ifdef FRUSTUM_CULLER_SSE2
+    const char* simdName = "SSE2";
+#else
+    const char* simdName = "no SIMD";
+#endif
+    printf("  %-7s       1 thread   %8.2f Mobjects/s  (%.2fx)\n", simdName, serialRate / 1e6, serialRate / scalarRate);
+    printf("  %-7s     %3u threads  %8.2f Mobjects/s  (%.2fx)\n", simdName, numThreads, parallelRate / 1e6, parallelRate / scalarRate);
+
+    bool matches = sameResults(scalarResults, serialResults) && sameResults(scalarResults, parallelResults);
+    printf("  visible objects and levels of scalar and SIMD culling %s\n", matches ? "match" : "DIFFER");
+
+    // No box with a corner in view may be culled
+    size_t wronglyCulled = 0;
+    for (size_t c = 0; c < cameraCount; c++)
+    {
+        std::vector<bool> kept(objectCount, false);
+        for (const std::vector<uint32_t>& level : serialResults[c].levels)
+        {
+            for (uint32_t i : level) { kept[i] = true; }
+        }
+        for (size_t i = 0; i < std::min(checkCount, objectCount); i++) { wronglyCulled += !kept[i] && hasCornerInside(viewProjections[c], bounds, i) ? 1 : 0; }
+    }
+    printf("  first %zu objects: %zu culled with a corner in view\n", std::min(checkCount, objectCount), wronglyCulled);
+    return matches && wronglyCulled == 0;
+}
+
+int main(int argc, char** argv)
+{
+    /* Parse Command Line Arguements */
+    std::vector<size_t> objectCounts;
+    size_t cameraCount = 20;
+    size_t checkCount = 100000;
+    unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--cameras" && i + 1 < argc) { cameraCount = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10)); }
+        else if (arg == "--check" && i + 1 < argc) { checkCount = std::strtoull(argv[++i], nullptr, 10); }
+        else if (arg == "--threads" && i + 1 < argc) { numThreads = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg[0] != '-') { objectCounts.push_back(std::strtoull(argv[i], nullptr, 10)); }
+        else
+        {
+            std::cerr << "Usage: CullingBenchmark [objectCount...] [--cameras N] [--threads N] [--check N]" << std::endl;
+            return -1;
+        }
+    }
+    if (objectCounts.empty()) { objectCounts = { 10000, 100000, 1000000, 4000000 }; }
+
+    bool allMatch = true;
+    for (size_t objectCount : objectCounts) { allMatch = benchmarkBounds(objectCount, cameraCount, numThreads, checkCount) && allMatch; }
+    return allMatch ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <thread>
+#include <filesystem>
+#include <algorithm>
+#include "cyTriMesh.h"
+#include "cyMatrix.h"
+#include "lodepng.h"
+#include "MeshData.h"
+#include "SoftwareRasterizer.h"
+#include "DrawList.h"
+#include "SceneLayout.h"
+#include "OrbitalObject.h"
+#include "MeshCache.h"
+#include "FrameReport.h"
+
+/* Write a synthetic sphere with positions, uvs, normals, and two materials split at the equator to an obj file.
+   Rings and segments are chosen for about faceCount faces, the faces at the poles are degenerate like in many exported meshes. */
+bool writeSyntheticSphere(const std::filesystem::path& objPath, unsigned int faceCount)
+{
+    unsigned int rings = std::max(2u, static_cast<unsigned int>(std::ceil(std::sqrt(faceCount / 4.0))));
+    unsigned int segments = 2*rings;
+
+    std::filesystem::path mtlPath = objPath;
+    mtlPath.replace_extension(".mtl");
+    std::ofstream mtl(mtlPath);
+    mtl << "newmtl north\nKd 0.8 0.3 0.2\nKs 0.5 0.5 0.5\nNs 32\nnewmtl south\nKd 0.2 0.4 0.8\nKs 0.5 0.5 0.5\nNs 8\n";
+    if (!mtl) { return false; }
+
+    FILE* fp = fopen(objPath.string().c_str(), "wb");
+    if (!fp) { return false; }
+    std::vector<char> buffer(1 << 20);
+    setvbuf(fp, buffer.data(), _IOFBF, buffer.size());
+
+    fprintf(fp, "# synthetic sphere with %u faces\nmtllib %s\n", 2*rings*segments, mtlPath.filename().string().c_str());
+    for (unsigned int ring = 0; ring <= rings; ring++)
+    {
+        float theta = cy::Pi<float>()*ring / rings;
+        for (unsigned int segment = 0; segment <= segments; segment++)
+        {
+            float phi = 2.0f*cy::Pi<float>()*segment / segments;
+            cy::Vec3f normal(std::sin(theta)*std::cos(phi), std::sin(theta)*std::sin(phi), std::cos(theta));
+            fprintf(fp, "v %.6f %.6f %.6f\n", normal.x, normal.y, normal.z);
+            fprintf(fp, "vt %.6f %.6f\n", static_cast<float>(segment) / segments, static_cast<float>(ring) / rings);
+            fprintf(fp, "vn %.6f %.6f %.6f\n", normal.x, normal.y, normal.z);
+        }
+    }
+
+    for (unsigned int ring = 0; ring < rings; ring++)
+    {
+        if (ring == 0) { fprintf(fp, "usemtl north\n"); }
+        if (ring == rings / 2) { fprintf(fp, "usemtl south\n"); }
+        for (unsigned int segment = 0; segment < segments; segment++)
+        {
+            unsigned int a = ring*(segments + 1) + segment + 1;
+            unsigned int b = a + 1;
+            unsigned int c = a + segments + 1;
+            unsigned int d = c + 1;
+            fprintf(fp, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, c, c, c, d, d, d);
+            fprintf(fp, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, d, d, d, b, b, b);
+        }
+    }
+    return fclose(fp) == 0;
+}
+
+/* FNV-1a of the last frame, so renders of the same mesh can be compared between commits */
+uint64_t hashImage(const std::vector<unsigned char>& color)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char byte : color) { hash = (hash ^ byte) * 1099511628211ull; }
+    return hash;
+}
+
+double millisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/* Run GraphicsProject on an obj file with the scripted orbit and a hidden window, rebuilding the mesh cache so the obj file is parsed,
+   and read the meshes of the results it writes. Every mesh runs in its own process, so the peak memory is its own on every platform. */
+bool benchmarkMeshOpenGL(const std::filesystem::path& appPath, const std::filesystem::path& objPath, unsigned int frameCount, size_t stressInstanceCount,
+                         const std::filesystem::path& directory, std::string& meshesJson)
+{
+    std::filesystem::path resultsPath = directory / (objPath.stem().string() + "_results.json");
+    std::filesystem::remove(resultsPath);
+    std::string command = "\"" + appPath.string() + "\" \"" + objPath.string() + "\" --rebuild-cache --orbit " + std::to_string(frameCount)
+                        + " --results \"" + resultsPath.string() + "\"";
+    if (stressInstanceCount > 0) { command += " --stress " + std::to_string(stressInstanceCount); }
+#if defined(_WIN32)
+    // cmd.exe strips the outer quotes of a command line starting with a quote
+    command = "\"" + command + "\"";
+#endif
+    // The output of GraphicsProject follows what was printed so far
+    fflush(stdout);
+    int exitCode = std::system(command.c_str());
+    bool succeeded = exitCode == 0 && FrameReport::ReadMeshesJson(resultsPath.string(), meshesJson);
+    if (!succeeded) { std::cerr << "GraphicsProject did not write results for " << objPath << ", exit code " << exitCode << std::endl; }
+    std::filesystem::remove(resultsPath);
+    return succeeded;
+}
+
+/* Load an obj file like GraphicsProject without the mesh cache, then replay the orbit of the camera and light with the software rasterizer */
+bool benchmarkMeshSoftware(const std::filesystem::path& objPath, const std::string& name, unsigned int width, unsigned int height, unsigned int frameCount,
+                           unsigned int numThreads, const std::string& pngFilePath, FrameReportMesh& result)
+{
+    FrameReport::ResetPeakResidentBytes();
+    result.name = name;
+    result.width = width;
+    result.height = height;
+    result.frameTimes = FrameStatistics(frameCount);
+
+    auto parseStart = std::chrono::steady_clock::now();
+    cy::TriMesh mesh;
+    bool meshIsReady = mesh.LoadFromFileObj(objPath.string().c_str(), true, nullptr, numThreads) && mesh.HasNormals() && mesh.HasTextureVertices();
+    MeshData meshData;
+    if (!meshIsReady || !meshData.BuildFromTriMesh(mesh))
+    {
+        std::cerr << "Could not load mesh with normals and uvs from obj file at path: " << objPath << std::endl;
+        return false;
+    }
+    auto buildEnd = std::chrono::steady_clock::now();
+    mesh.Clear();
+    result.meshMilliseconds = millisecondsBetween(parseStart, buildEnd);
+
+    RasterTextureFiles textures(objPath, &std::cerr);
+    std::vector<RasterMaterial> materials = SoftwareRasterizer::MaterialsOf(meshData, [&](const char* textureName) { return textures.Get(textureName); });
+    std::vector<RasterDraw> draws = SoftwareRasterizer::DrawsOf(DrawList::MaterialRanges(meshData), materials);
+    result.textureMilliseconds = millisecondsBetween(buildEnd, std::chrono::steady_clock::now());
+    result.totalMilliseconds = result.meshMilliseconds + result.textureMilliseconds;
+    result.triangleCount = meshData.indexCount / 3;
+    result.vertexCount = meshData.vertexCount;
+    result.drawCount = draws.size();
+
+    // Turned z up to y up like in GraphicsProject and scaled to unit radius, so every mesh covers the same part of the screen
+    float meshRadius = std::max((meshData.boundMax - meshData.boundMin).Length()/2, 1e-6f);
+    cy::Matrix4f modelMatrix = SceneLayout::ModelMatrix(meshData.boundMin, meshData.boundMax, 1.0f/meshRadius);
+    cy::Matrix4f perspectiveMatrix = cy::Matrix4f::Perspective(75.0f*cy::Pi<float>()/180.0f, static_cast<float>(width)/height, 0.1f, 1000.0f);
+
+    // The camera and light start where GraphicsProject places them
+    OrbitalObject camera;
+    OrbitalObject light;
+    light.update(0, -70.0f*cy::Pi<float>()/180.0f, 0);
+    OrbitPath orbitPath(frameCount);
+
+    SoftwareRasterizer rasterizer;
+    rasterizer.Resize(width, height, numThreads);
+    for (unsigned int frame = 0; frame < frameCount; frame++)
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+        OrbitStep step = orbitPath.Step(frame);
+        camera.update(step.cameraPhiDelta, step.cameraThetaDelta, step.cameraRadiusDelta);
+        light.update(step.lightPhiDelta, step.lightThetaDelta, 0);
+        cy::Matrix4f viewMatrix = camera.getViewMatrix();
+        RasterUniforms uniforms;
+        uniforms.mvp = perspectiveMatrix * viewMatrix * modelMatrix;
+        uniforms.mv = viewMatrix * modelMatrix;
+        uniforms.mvNormal = cy::Matrix3f(viewMatrix * modelMatrix).GetInverse().GetTranspose();
+        uniforms.lightPosition = cy::Vec3f(viewMatrix * cy::Vec4f(light.currentPosition, 1.0f));
+        rasterizer.Clear(0, 0, 0);
+        rasterizer.DrawMesh(meshData, draws, uniforms);
+        result.frameTimes.Add(millisecondsBetween(frameStart, std::chrono::steady_clock::now()));
+    }
+    char imageHash[32];
+    snprintf(imageHash, sizeof(imageHash), "%016llx", static_cast<unsigned long long>(hashImage(rasterizer.Color())));
+    result.imageHash = imageHash;
+    result.peakResidentBytes = FrameReport::PeakResidentBytes();
+
+    if (!pngFilePath.empty())
+    {
+        std::filesystem::path framePath = pngFilePath;
+        framePath.replace_filename(framePath.stem().string() + "_" + name + framePath.extension().string());
+        unsigned pngLodeError = rasterizer.WritePng(framePath.string());
+        if (pngLodeError) { std::cerr << "Could not write " << framePath.string() << ": " << lodepng_error_text(pngLodeError) << std::endl; return false; }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    /* Parse Command Line Arguements */
+    std::vector<unsigned int> faceCounts;
+    std::vector<std::filesystem::path> objPaths;
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+#if defined(_WIN32)
+    std::filesystem::path appPath = std::filesystem::path(argv[0]).parent_path() / "GraphicsProject.exe";
+#else
+    std::filesystem::path appPath = std::filesystem::path(argv[0]).parent_path() / "GraphicsProject";
+#endif
+    std::string jsonFilePath = "FrameBenchmark.json";
+    std::string pngFilePath;
+    bool software = false;
+    size_t stressInstanceCount = 0;
+    unsigned int width = 1280;
+    unsigned int height = 960;
+    unsigned int frameCount = 120;
+    unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--obj" && i + 1 < argc) { objPaths.push_back(argv[++i]); }
+        else if (arg == "--frames" && i + 1 < argc) { frameCount = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--app" && i + 1 < argc) { appPath = argv[++i]; }
+        else if (arg == "--stress" && i + 1 < argc) { stressInstanceCount = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10)); }
+        else if (arg == "--software") { software = true; }
+        else if (arg == "--threads" && i + 1 < argc) { numThreads = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--width" && i + 1 < argc) { width = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--height" && i + 1 < argc) { height = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--dir" && i + 1 < argc) { directory = argv[++i]; }
+        else if (arg == "--json" && i + 1 < argc) { jsonFilePath = argv[++i]; }
+        else if (arg == "--png" && i + 1 < argc) { pngFilePath = argv[++i]; }
+        else if (arg[0] != '-') { faceCounts.push_back(static_cast<unsigned int>(std::strtoul(argv[i], nullptr, 10))); }
+        else
+        {
+            std::cerr << "Usage: FrameBenchmark [faceCount...] [--obj path]... [--frames N] [--app GraphicsProject path] [--stress N] [--dir directory] [--json path]" << std::endl;
+            std::cerr << "       FrameBenchmark [faceCount...] [--obj path]... [--frames N] --software [--threads N] [--width W] [--height H] [--dir directory] [--json path] [--png path]" << std::endl;
+            return -1;
+        }
+    }
+    if (faceCounts.empty() && objPaths.empty()) { faceCounts = { 10000, 100000, 1000000 }; }
+    std::sort(faceCounts.begin(), faceCounts.end());
+
+    /* Measure the Synthetic Meshes from Smallest to Largest, then the Obj Files */
+    // GraphicsProject renders with OpenGL and is the renderer measured by default, the software rasterizer is for comparing machines without a GPU
+    std::vector<std::string> meshesJson;
+    if (software) { printf("Software rasterizer, %u frames at %ux%u on %u threads\n", frameCount, width, height, numThreads); }
+    else { printf("%s, %u frames\n", appPath.string().c_str(), frameCount); }
+    auto benchmark = [&](const std::filesystem::path& objPath, const std::string& name)
+    {
+        if (!software)
+        {
+            meshesJson.emplace_back();
+            return benchmarkMeshOpenGL(appPath, objPath, frameCount, stressInstanceCount, directory, meshesJson.back());
+        }
+        FrameReportMesh result;
+        if (!benchmarkMeshSoftware(objPath, name, width, height, frameCount, numThreads, pngFilePath, result)) { return false; }
+        const FrameStatistics& frames = result.frameTimes;
+        printf("%s: %zu triangles, loaded in %.1f ms, peak RSS %.1f MB\n", name.c_str(), result.triangleCount, result.totalMilliseconds, result.peakResidentBytes / (1024.0*1024.0));
+        printf("  frame ms  min %8.2f  avg %8.2f  p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f\n", frames.Min(), frames.Average(),
+               frames.Percentile(0.5), frames.Percentile(0.9), frames.Percentile(0.99), frames.Max());
+        meshesJson.push_back(FrameReport::MeshJson(result));
+        return true;
+    };
+    for (unsigned int faceCount : faceCounts)
+    {
+        std::string name = "sphere_" + std::to_string(faceCount);
+        std::filesystem::path objPath = directory / (name + ".obj");
+        if (!writeSyntheticSphere(objPath, faceCount))
+        {
+            std::cerr << "Could not write synthetic obj file " << objPath << std::endl;
+            return -1;
+        }
+        bool succeeded = benchmark(objPath, name);
+        std::filesystem::remove(objPath);
+        std::filesystem::remove(MeshCache::PathFor(objPath));
+        std::filesystem::path mtlPath = objPath;
+        std::filesystem::remove(mtlPath.replace_extension(".mtl"));
+        if (!succeeded) { return -1; }
+    }
+    for (const std::filesystem::path& objPath : objPaths)
+    {
+        if (!benchmark(objPath, objPath.stem().string())) { return -1; }
+    }
+
+    if (!FrameReport::Write(jsonFilePath, "FrameBenchmark", software ? "software" : "opengl", frameCount, meshesJson, &std::cerr)) { return -1; }
+    printf("Wrote results to %s\n", jsonFilePath.c_str());
+    return 0;
+}
@@ -0,0 +1,317 @@
+#ifndef LEGACY_OBJ_LOADER_H
+#define LEGACY_OBJ_LOADER_H
+
+#include "cyTriMesh.h"
+#include <string>
+
+_CY_CRT_SECURE_NO_WARNINGS
+
+namespace cy {
+
+/* The original line-by-line OBJ loader of cy::TriMesh (fgetc and sscanf), kept as the reference for ObjLoadBenchmark */
+class LegacyTriMesh : public TriMesh
+{
+public:
+	bool LoadFromFileObj( char const *filename, bool loadMtl=true, std::ostream *outStream=&std::cout );
+private:
+	struct MtlData
+	{
+		std::string mtlName;
+		unsigned int firstFace;
+		unsigned int faceCount;
+		MtlData() { faceCount=0; firstFace=0; }
+	};
+	struct MtlLibName { std::string filename; };
+};
+
+inline bool LegacyTriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::ostream *outStream )
+{
+	FILE *fp = fopen(filename,"r");
+	if ( !fp ) {
+		if ( outStream ) *outStream << "ERROR: Cannot open file " << filename << std::endl;
+		return false;
+	}
+
+	Clear();
+
+	class Buffer
+	{
+		char data[1024];
+		int readLine;
+	public:
+		int ReadLine(FILE *fp)
+		{
+			int c = fgetc(fp);
+			while ( !feof(fp) ) {
+				while ( isspace(c) && ( !feof(fp) || c!='\0' ) ) c = fgetc(fp);	// skip empty space
+				if ( c == '#' ) while ( !feof(fp) && c!='\n' && c!='\r' && c!='\0' ) c = fgetc(fp);	// skip comment line
+				else break;
+			}
+			int i=0;
+			bool inspace = false;
+			while ( i<1024-1 ) {
+				if ( feof(fp) || c=='\n' || c=='\r' || c=='\0' ) break;
+				if ( isspace(c) ) {	// only use a single space as the space character
+					inspace = true;
+				} else {
+					if ( inspace ) data[i++] = ' ';
+					inspace = false;
+					data[i++] = static_cast<char>(c);
+				}
+				c = fgetc(fp);
+			}
+			data[i] = '\0';
+			readLine = i;
+			return i;
+		}
+		char& operator[](int i) { return data[i]; }
+		void ReadVertex( Vec3f &v ) const { v.Zero(); sscanf( data+2, "%f %f %f", &v.x, &v.y, &v.z ); }
+		void ReadFloat3( float f[3] ) const { f[2]=f[1]=f[0]=0; int n = sscanf( data+2, "%f %f %f", &f[0], &f[1], &f[2] ); if ( n==1 ) f[2]=f[1]=f[0]; }
+		void ReadFloat( float *f ) const { sscanf( data+2, "%f", f ); }
+		void ReadInt( int *i, int start ) const { sscanf( data+start, "%d", i ); }
+		bool IsCommand( char const *cmd ) const {
+			int i=0;
+			while ( cmd[i]!='\0' ) {
+				if ( cmd[i] != data[i] ) return false;
+				i++;
+			}
+			return (data[i]=='\0' || data[i]==' ');
+		}
+		char const * Data(int start=0) { return data+start; }
+		void Copy( Str &str, int start=0 )
+		{
+			while ( data[start] != '\0' && data[start] <= ' ' ) start++;
+			str = Data(start);
+		}
+	};
+	Buffer buffer;
+
+
+	struct MtlList {
+		std::vector<MtlData> mtlData;
+		int GetMtlIndex( char const *mtlName )
+		{
+			for ( unsigned int i=0; i<mtlData.size(); i++ ) {
+				if ( mtlData[i].mtlName == mtlName ) return (int)i;
+			}
+			return -1;
+		}
+		int CreateMtl( char const *mtlName, unsigned int firstFace )
+		{
+			if ( mtlName[0] == '\0' ) return 0;
+			int i = GetMtlIndex(mtlName);
+			if ( i >= 0 ) return i;
+			MtlData m;
+			m.mtlName = mtlName;
+			m.firstFace = firstFace;
+			mtlData.push_back(m);
+			return (int)mtlData.size()-1;
+		}
+	};
+	MtlList mtlList;
+
+	std::vector<Vec3f>      _v;		// vertices
+	std::vector<TriFace>    _f;		// faces
+	std::vector<Vec3f>      _vn;	// vertex normal
+	std::vector<TriFace>    _fn;	// normal faces
+	std::vector<Vec3f>      _vt;	// texture vertices
+	std::vector<TriFace>    _ft;	// texture faces
+	std::vector<MtlLibName> mtlFiles;
+	std::vector<int>        faceMtlIndex;
+
+	int currentMtlIndex = -1;
+	bool hasTextures=false, hasNormals=false;
+
+	while ( int rb = buffer.ReadLine(fp) ) {
+		if ( buffer.IsCommand("v") ) {
+			Vec3f vertex;
+			buffer.ReadVertex(vertex);
+			_v.push_back(vertex);
+		}
+		else if ( buffer.IsCommand("vt") ) {
+			Vec3f texVert;
+			buffer.ReadVertex(texVert);
+			_vt.push_back(texVert);
+			hasTextures = true;
+		}
+		else if ( buffer.IsCommand("vn") ) {
+			Vec3f normal;
+			buffer.ReadVertex(normal);
+			_vn.push_back(normal);
+			hasNormals = true;
+		}
+		else if ( buffer.IsCommand("f") ) {
+			int facevert = -1;
+			bool inspace = true;
+			bool negative = false;
+			int type = 0;
+			unsigned int index;
+			TriFace face, textureFace, normalFace;
+			unsigned int nFacesBefore = (unsigned int)_f.size();
+			for ( int i=2; i<rb; i++ ) {
+				if ( buffer[i] == ' ' ) inspace = true;
+				else {
+					if ( inspace ) {
+						inspace=false;
+						negative = false;
+						type=0;
+						index=0;
+						switch ( facevert ) {
+							case -1:
+								// initialize face
+								face.v[0] = face.v[1] = face.v[2] = 0;
+								textureFace.v[0] = textureFace.v[1] = textureFace.v[2] = 0;
+								normalFace. v[0] = normalFace. v[1] = normalFace. v[2] = 0;
+								[[fallthrough]];
+							case 0:
+							case 1:
+								facevert++;
+								break;
+							case 2:
+								// copy the first two vertices from the previous face
+								_f.push_back(face);
+								face.v[1] = face.v[2];
+								if ( hasTextures ) {
+									_ft.push_back(textureFace);
+									textureFace.v[1] = textureFace.v[2];
+								}
+								if ( hasNormals ) {
+									_fn.push_back(normalFace);
+									normalFace.v[1] = normalFace.v[2];
+								}
+								faceMtlIndex.push_back(currentMtlIndex);
+								break;
+						}
+					}
+					if ( buffer[i] == '/' ) { type++; index=0; }
+					if ( buffer[i] == '-' ) negative = true;
+					if ( buffer[i] >= '0' && buffer[i] <= '9' ) {
+						index = index*10 + (buffer[i]-'0');
+						switch ( type ) {
+							case 0: face.v       [facevert] = negative ? (unsigned int)_v. size()-index : index-1; break;
+							case 1: textureFace.v[facevert] = negative ? (unsigned int)_vt.size()-index : index-1; hasTextures=true; break;
+							case 2: normalFace.v [facevert] = negative ? (unsigned int)_vn.size()-index : index-1; hasNormals =true; break;
+						}
+					}
+				}
+			}
+			_f.push_back(face);
+			if ( hasTextures ) _ft.push_back(textureFace);
+			if ( hasNormals  ) _fn.push_back(normalFace);
+			faceMtlIndex.push_back(currentMtlIndex);
+			if ( currentMtlIndex>=0 ) mtlList.mtlData[currentMtlIndex].faceCount += (unsigned int)_f.size() - nFacesBefore;
+		}
+		else if ( loadMtl ) {
+			if ( buffer.IsCommand("usemtl") ) {
+				currentMtlIndex = mtlList.CreateMtl(buffer.Data(7), (unsigned int)_f.size());
+			}
+			if ( buffer.IsCommand("mtllib") ) {
+				MtlLibName libName;
+				libName.filename = buffer.Data(7);
+				mtlFiles.push_back(libName);
+			}
+		}
+		if ( feof(fp) ) break;
+	}
+
+	fclose(fp);
+
+
+	if ( _f.size() == 0 ) return true; // No faces found
+	SetNumVertex((unsigned int)_v.size());
+	SetNumFaces((unsigned int)_f.size());
+	SetNumTexVerts((unsigned int)_vt.size());
+	SetNumNormals((unsigned int)_vn.size());
+	if ( loadMtl ) SetNumMtls((unsigned int)mtlList.mtlData.size());
+
+	// Copy data
+	memcpy(v, _v.data(), sizeof(Vec3f)*_v.size());
+	if ( _vt.size() > 0 ) memcpy(vt, _vt.data(), sizeof(Vec3f)*_vt.size());
+	if ( _vn.size() > 0 ) memcpy(vn, _vn.data(), sizeof(Vec3f)*_vn.size());
+
+	if ( mtlList.mtlData.size() > 0 ) {
+		unsigned int fid = 0;
+		for ( int mi=0; mi<(int)mtlList.mtlData.size(); mi++ ) {
+			for ( unsigned int i=mtlList.mtlData[mi].firstFace, j=0; j<mtlList.mtlData[mi].faceCount && i<_f.size(); i++ ) {
+				if ( faceMtlIndex[i] == mi ) {
+					f[fid] = _f[i];
+					if ( fn ) fn[fid] = _fn[i];
+					if ( ft ) ft[fid] = _ft[i];
+					fid++;
+					j++;
+				}
+			}
+			mcfc[mi] = fid;
+		}
+		if ( fid <_f.size() ) {
+			for ( unsigned int i=0; i<_f.size(); i++ ) {
+				if ( faceMtlIndex[i] < 0 ) {
+					f[fid] = _f[i];
+					if ( fn ) fn[fid] = _fn[i];
+					if ( ft ) ft[fid] = _ft[i];
+					fid++;
+				}
+			}
+		}
+	} else {
+		memcpy(f, _f.data(), sizeof(TriFace)*_f.size());
+		if ( ft ) memcpy(ft, _ft.data(), sizeof(TriFace)*_ft.size());
+		if ( fn ) memcpy(fn, _fn.data(), sizeof(TriFace)*_fn.size());
+	}
+
+
+	// Load the .mtl files
+	if ( loadMtl ) {
+		// get the path from filename
+		char *mtlPathName = nullptr;
+		char const *pathEnd = strrchr(filename,'\\');
+		if ( !pathEnd ) pathEnd = strrchr(filename,'/');
+		if ( pathEnd ) {
+			int n = int(pathEnd-filename) + 1;
+			mtlPathName = new char[n+1];
+			strncpy(mtlPathName,filename,n);
+			mtlPathName[n] = '\0';
+		}
+		for ( unsigned int mi=0; mi<mtlFiles.size(); mi++ ) {
+			std::string mtlFilename = ( mtlPathName ) ? std::string(mtlPathName) + mtlFiles[mi].filename : mtlFiles[mi].filename;
+			FILE *fpm = fopen(mtlFilename.data(),"r");
+			if ( !fpm ) {
+				if ( outStream ) *outStream << "ERROR: Cannot open file " << mtlFilename.c_str() << std::endl;
+				continue;
+			}
+			int mtlID = -1;
+			while ( buffer.ReadLine(fpm) ) {
+				if ( buffer.IsCommand("newmtl") ) {
+					mtlID = mtlList.GetMtlIndex(buffer.Data(7));
+					if ( mtlID >= 0 ) buffer.Copy( m[mtlID].name, 7 );
+				} else if ( mtlID >= 0 ) {
+					if ( buffer.IsCommand("Ka") ) buffer.ReadFloat3( m[mtlID].Ka );
+					else if ( buffer.IsCommand("Kd") ) buffer.ReadFloat3( m[mtlID].Kd );
+					else if ( buffer.IsCommand("Ks") ) buffer.ReadFloat3( m[mtlID].Ks );
+					else if ( buffer.IsCommand("Tf") ) buffer.ReadFloat3( m[mtlID].Tf );
+					else if ( buffer.IsCommand("Ns") ) buffer.ReadFloat( &m[mtlID].Ns );
+					else if ( buffer.IsCommand("Ni") ) buffer.ReadFloat( &m[mtlID].Ni );
+					else if ( buffer.IsCommand("illum") ) buffer.ReadInt( &m[mtlID].illum, 5 );
+					else if ( buffer.IsCommand("map_Ka"  ) ) buffer.Copy( m[mtlID].map_Ka,   7 );
+					else if ( buffer.IsCommand("map_Kd"  ) ) buffer.Copy( m[mtlID].map_Kd,   7 );
+					else if ( buffer.IsCommand("map_Ks"  ) ) buffer.Copy( m[mtlID].map_Ks,   7 );
+					else if ( buffer.IsCommand("map_Ns"  ) ) buffer.Copy( m[mtlID].map_Ns,   7 );
+					else if ( buffer.IsCommand("map_d"   ) ) buffer.Copy( m[mtlID].map_d,    6 );
+					else if ( buffer.IsCommand("map_bump") ) buffer.Copy( m[mtlID].map_bump, 9 );
+					else if ( buffer.IsCommand("bump"    ) ) buffer.Copy( m[mtlID].map_bump, 5 );
+					else if ( buffer.IsCommand("map_disp") ) buffer.Copy( m[mtlID].map_disp, 9 );
+					else if ( buffer.IsCommand("disp"    ) ) buffer.Copy( m[mtlID].map_disp, 5 );
+				}
+			}
+			fclose(fpm);
+		}
+		if ( mtlPathName ) delete [] mtlPathName;
+	}
+
+	return true;
+}
+
+} // namespace cy
+
+_CY_CRT_SECURE_RESUME_WARNINGS
+#endif
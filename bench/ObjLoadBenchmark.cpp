@@ -0,0 +1,301 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <filesystem>
+#include "cyTriMesh.h"
+#include "LegacyObjLoader.h"
+#include "MeshData.h"
+#include "MeshCache.h"
+
+/* Write a synthetic grid mesh with positions, uvs, normals, and two materials to an obj file */
+bool writeSyntheticObj(const std::filesystem::path& objPath, unsigned int faceCount)
+{
+    unsigned int quadsPerSide = static_cast<unsigned int>(std::ceil(std::sqrt(faceCount / 2.0)));
+    unsigned int vertsPerSide = quadsPerSide + 1;
+
+    std::filesystem::path mtlPath = objPath;
+    mtlPath.replace_extension(".mtl");
+    std::ofstream mtl(mtlPath);
+    mtl << "newmtl first\nKd 1 0 0\nnewmtl second\nKd 0 1 0\n";
+    if (!mtl) { return false; }
+
+    FILE* fp = fopen(objPath.string().c_str(), "wb");
+    if (!fp) { return false; }
+    std::vector<char> buffer(1 << 20);
+    setvbuf(fp, buffer.data(), _IOFBF, buffer.size());
+
+    fprintf(fp, "# synthetic grid with %u faces\nmtllib %s\n", faceCount, mtlPath.filename().string().c_str());
+    for (unsigned int y = 0; y < vertsPerSide; y++)
+    {
+        for (unsigned int x = 0; x < vertsPerSide; x++)
+        {
+            float u = static_cast<float>(x) / quadsPerSide;
+            float v = static_cast<float>(y) / quadsPerSide;
+            fprintf(fp, "v %.6f %.6f %.6f\n", u*10.0f, v*10.0f, 0.25f*std::sin(u*20.0f)*std::cos(v*20.0f));
+            fprintf(fp, "vt %.6f %.6f\n", u, v);
+            fprintf(fp, "vn %.6f %.6f %.6f\n", 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    unsigned int facesWritten = 0;
+    for (unsigned int y = 0; y < quadsPerSide && facesWritten < faceCount; y++)
+    {
+        if (y == 0) { fprintf(fp, "usemtl first\n"); }
+        if (y == quadsPerSide / 2) { fprintf(fp, "usemtl second\n"); }
+        for (unsigned int x = 0; x < quadsPerSide && facesWritten < faceCount; x++)
+        {
+            unsigned int a = y*vertsPerSide + x + 1;
+            unsigned int b = a + 1;
+            unsigned int c = a + vertsPerSide;
+            unsigned int d = c + 1;
+            fprintf(fp, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, d, d, d);
+            facesWritten++;
+            if (facesWritten < faceCount)
+            {
+                fprintf(fp, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, d, d, d, c, c, c);
+                facesWritten++;
+            }
+        }
+    }
+    return fclose(fp) == 0;
+}
+
+/* Compare every component of two meshes bit by bit */
+bool meshesAreIdentical(const cy::TriMesh& a, const cy::TriMesh& b)
+{
+    if (a.NV() != b.NV() || a.NF() != b.NF() || a.NVT() != b.NVT() || a.NVN() != b.NVN() || a.NM() != b.NM()) { return false; }
+    if (a.NV() > 0 && memcmp(&a.V(0), &b.V(0), a.NV()*sizeof(cy::Vec3f)) != 0) { return false; }
+    if (a.NVT() > 0 && memcmp(&a.VT(0), &b.VT(0), a.NVT()*sizeof(cy::Vec3f)) != 0) { return false; }
+    if (a.NVN() > 0 && memcmp(&a.VN(0), &b.VN(0), a.NVN()*sizeof(cy::Vec3f)) != 0) { return false; }
+    if (a.NF() > 0 && memcmp(&a.F(0), &b.F(0), a.NF()*sizeof(cy::TriMesh::TriFace)) != 0) { return false; }
+    if (a.NF() > 0 && a.NVT() > 0 && memcmp(&a.FT(0), &b.FT(0), a.NF()*sizeof(cy::TriMesh::TriFace)) != 0) { return false; }
+    if (a.NF() > 0 && a.NVN() > 0 && memcmp(&a.FN(0), &b.FN(0), a.NF()*sizeof(cy::TriMesh::TriFace)) != 0) { return false; }
+    for (unsigned int i = 0; i < a.NM(); i++)
+    {
+        if (a.GetMaterialFaceCount(i) != b.GetMaterialFaceCount(i)) { return false; }
+        const char* nameA = a.M(i).name.data ? a.M(i).name.data : "";
+        const char* nameB = b.M(i).name.data ? b.M(i).name.data : "";
+        if (strcmp(nameA, nameB) != 0) { return false; }
+        if (memcmp(a.M(i).Kd, b.M(i).Kd, sizeof(a.M(i).Kd)) != 0) { return false; }
+    }
+    return true;
+}
+
+/* Run a loader several times and keep the fastest time in seconds */
+template <typename Loader>
+double timeLoader(Loader load, int runs)
+{
+    double best = 1e30;
+    for (int run = 0; run < runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool loaded = load();
+        auto end = std::chrono::steady_clock::now();
+        if (!loaded) { return -1.0; }
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+void printResult(const char* loaderName, unsigned int faceCount, double megabytes, double seconds)
+{
+    printf("%10u  %-8s  %9.3f  %9.1f  %10.2f\n", faceCount, loaderName, seconds, megabytes / seconds, faceCount / seconds / 1e6);
+}
+
+/* Order independent hash of the triangles in every material range, so reordering passes can be checked against the original mesh */
+std::vector<uint64_t> hashMaterialTriangles(const MeshData& meshData)
+{
+    std::vector<uint32_t> indices32 = meshData.GetIndices32();
+    std::vector<uint64_t> hashes(meshData.materialCount, 0);
+    for (size_t materialIndex = 0; materialIndex < meshData.materialCount; materialIndex++)
+    {
+        const MeshMaterial& material = meshData.materials[materialIndex];
+        for (size_t i = material.firstIndex; i + 2 < static_cast<size_t>(material.firstIndex) + material.indexCount; i += 3)
+        {
+            MeshVertex triangle[3] = { meshData.vertices[indices32[i]], meshData.vertices[indices32[i + 1]], meshData.vertices[indices32[i + 2]] };
+            hashes[materialIndex] += MeshCache::HashBytes(reinterpret_cast<const unsigned char*>(triangle), sizeof(triangle));
+        }
+    }
+    return hashes;
+}
+
+/* Index sequences whose cache misses were counted by hand, so the simulation reported for every mesh can be trusted */
+bool checkVertexCacheSimulation()
+{
+    struct Case { std::vector<uint32_t> indices; unsigned int cacheSize; MeshOptimizer::CacheModel model; double acmr; };
+    const Case cases[] = {
+        { { 0, 1, 2, 0, 1, 2 }, 3, MeshOptimizer::CacheModel::Fifo, 1.5 },  // all three vertices fit, only the first triangle misses
+        { { 0, 1, 2, 0, 1, 2 }, 3, MeshOptimizer::CacheModel::Lru, 1.5 },
+        { { 0, 1, 2, 0, 3, 0 }, 3, MeshOptimizer::CacheModel::Fifo, 2.5 },  // 3 evicts 0, the oldest insertion, even though 0 was just used
+        { { 0, 1, 2, 0, 3, 0 }, 3, MeshOptimizer::CacheModel::Lru, 2.0 },   // 3 evicts 1, the least recently used
+    };
+    bool allMatch = true;
+    for (const Case& c : cases)
+    {
+        double acmr = MeshOptimizer::SimulateVertexCache(c.indices, 4, c.cacheSize, c.model).acmr;
+        if (acmr != c.acmr)
+        {
+            printf("%10s  %s %u cache of a hand counted case: ACMR %.3f instead of %.3f\n", "", c.model == MeshOptimizer::CacheModel::Fifo ? "fifo" : "lru", c.cacheSize, acmr, c.acmr);
+            allMatch = false;
+        }
+    }
+    printf("%10s  vertex cache simulation %s the hand counted cases\n", "", allMatch ? "matches" : "DIFFERS from");
+    return allMatch;
+}
+
+/* Time the vertex order optimization and report the simulated vertex cache before and after it */
+bool benchmarkOptimizer(cy::TriMesh& mesh, int runs)
+{
+    MeshData original;
+    if (!original.BuildFromTriMesh(mesh)) { return true; }
+    MeshData optimized;
+    double seconds = 1e30;
+    for (int run = 0; run < runs; run++)
+    {
+        optimized.BuildFromTriMesh(mesh);
+        auto start = std::chrono::steady_clock::now();
+        bool reordered = optimized.OptimizeVertexOrder();
+        auto end = std::chrono::steady_clock::now();
+        if (!reordered) { return false; }
+        seconds = std::min(seconds, std::chrono::duration<double>(end - start).count());
+    }
+    printf("%10u  %-8s  %9.3f  %9s  %10.2f\n", mesh.NF(), "optimize", seconds, "", mesh.NF() / seconds / 1e6);
+
+    const unsigned int cacheSizes[] = { 16, 32 };
+    for (MeshOptimizer::CacheModel model : { MeshOptimizer::CacheModel::Fifo, MeshOptimizer::CacheModel::Lru })
+    {
+        for (unsigned int cacheSize : cacheSizes)
+        {
+            VertexCacheStats before = original.SimulateVertexCache(cacheSize, model);
+            VertexCacheStats after = optimized.SimulateVertexCache(cacheSize, model);
+            printf("%10s  %s %2u  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", "", model == MeshOptimizer::CacheModel::Fifo ? "fifo" : "lru ", cacheSize,
+                   before.acmr, after.acmr, before.atvr, after.atvr);
+        }
+    }
+
+    bool rangesMatch = optimized.vertexCount == original.vertexCount && optimized.indexCount == original.indexCount
+        && memcmp(optimized.materials, original.materials, original.materialCount*sizeof(MeshMaterial)) == 0
+        && hashMaterialTriangles(optimized) == hashMaterialTriangles(original);
+    printf("%10s  material triangle sets %s\n", "", rangesMatch ? "identical" : "DIFFER");
+    return rangesMatch;
+}
+
+/* Time the serial, threaded, and legacy loaders on one obj file and check that they produce identical meshes */
+bool benchmarkFile(const std::filesystem::path& objPath, int runs, unsigned int numThreads, bool runLegacy, bool runOptimizer)
+{
+    double megabytes = std::filesystem::file_size(objPath) / (1024.0 * 1024.0);
+    std::string path = objPath.string();
+
+    cy::TriMesh mesh;
+    double seconds = timeLoader([&]() { return mesh.LoadFromFileObj(path.c_str(), true, nullptr, 1); }, runs);
+    printResult("serial", mesh.NF(), megabytes, seconds);
+
+    cy::TriMesh threadedMesh;
+    double threadedSeconds = timeLoader([&]() { return threadedMesh.LoadFromFileObj(path.c_str(), true, nullptr, numThreads); }, runs);
+    printResult("threaded", threadedMesh.NF(), megabytes, threadedSeconds);
+    bool identical = meshesAreIdentical(mesh, threadedMesh);
+    printf("%10s  threaded speedup %.2fx, meshes %s\n", "", seconds / threadedSeconds, identical ? "identical" : "DIFFER");
+
+    MeshData meshData;
+    if (meshData.BuildFromTriMesh(mesh))
+    {
+        std::filesystem::path cachePath = std::filesystem::temp_directory_path() / objPath.filename();
+        cachePath = MeshCache::PathFor(cachePath);
+        MeshCacheKey key;
+        bool cacheIsReady = MeshCache::ComputeKey(objPath, 0, key) && MeshCache::Save(cachePath, key, meshData);
+        bool cacheMatches = false;
+        MeshCache meshCache;
+        MeshData cachedMeshData;
+        double cacheSeconds = timeLoader([&]() { MeshCacheKey loadKey; return cacheIsReady && MeshCache::ComputeKey(objPath, 0, loadKey) && meshCache.Load(cachePath, loadKey, cachedMeshData); }, runs);
+        if (cacheSeconds >= 0.0)
+        {
+            printResult("cache", mesh.NF(), megabytes, cacheSeconds);
+            cacheMatches = cachedMeshData.vertexCount == meshData.vertexCount && cachedMeshData.materialCount == meshData.materialCount
+                && cachedMeshData.indexCount == meshData.indexCount && cachedMeshData.indexSize == meshData.indexSize
+                && memcmp(cachedMeshData.vertices, meshData.vertices, meshData.VertexBytes()) == 0
+                && memcmp(cachedMeshData.indices, meshData.indices, meshData.IndexBytes()) == 0
+                && memcmp(cachedMeshData.materials, meshData.materials, meshData.materialCount*sizeof(MeshMaterial)) == 0
+                && cachedMeshData.boundMin == meshData.boundMin && cachedMeshData.boundMax == meshData.boundMax;
+        }
+        printf("%10s  cache speedup over serial %.2fx, cached data %s\n", "", seconds / cacheSeconds, cacheMatches ? "identical" : "DIFFER");
+        identical = identical && cacheMatches;
+        std::filesystem::remove(cachePath);
+    }
+
+    if (runOptimizer)
+    {
+        identical = benchmarkOptimizer(mesh, runs) && identical;
+    }
+
+    if (runLegacy)
+    {
+        cy::LegacyTriMesh legacyMesh;
+        double legacySeconds = timeLoader([&]() { return legacyMesh.LoadFromFileObj(path.c_str(), true, nullptr); }, runs);
+        printResult("legacy", legacyMesh.NF(), megabytes, legacySeconds);
+        bool legacyIdentical = meshesAreIdentical(mesh, legacyMesh);
+        printf("%10s  serial speedup over legacy %.2fx, meshes %s\n", "", legacySeconds / seconds, legacyIdentical ? "identical" : "DIFFER");
+        identical = identical && legacyIdentical;
+    }
+    return identical;
+}
+
+int main(int argc, char** argv)
+{
+    /* Parse Command Line Arguements */
+    std::vector<unsigned int> faceCounts;
+    std::vector<std::filesystem::path> objPaths;
+    int runs = 3;
+    unsigned int numThreads = 0;
+    bool runLegacy = true;
+    bool runOptimizer = false;
+    std::filesystem::path workDirectory = std::filesystem::temp_directory_path();
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc) { runs = std::max(1, std::atoi(argv[++i])); }
+        else if (arg == "--threads" && i + 1 < argc) { numThreads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10)); }
+        else if (arg == "--obj" && i + 1 < argc) { objPaths.push_back(argv[++i]); }
+        else if (arg == "--dir" && i + 1 < argc) { workDirectory = argv[++i]; }
+        else if (arg == "--no-legacy") { runLegacy = false; }
+        else if (arg == "--optimize") { runOptimizer = true; }
+        else if (arg[0] != '-') { faceCounts.push_back(static_cast<unsigned int>(std::strtoul(argv[i], nullptr, 10))); }
+        else
+        {
+            std::cerr << "Usage: ObjLoadBenchmark [faceCount...] [--obj path]... [--runs N] [--threads N] [--dir directory] [--no-legacy] [--optimize]" << std::endl;
+            return -1;
+        }
+    }
+    if (faceCounts.empty() && objPaths.empty()) { faceCounts = { 1000000, 10000000 }; }
+
+    printf("%10s  %-8s  %9s  %9s  %10s\n", "faces", "loader", "time(s)", "MB/s", "Mfaces/s");
+    bool allIdentical = !runOptimizer || checkVertexCacheSimulation();
+    for (const std::filesystem::path& objPath : objPaths)
+    {
+        if (!std::filesystem::exists(objPath))
+        {
+            std::cerr << "Could not find obj file at path: " << objPath << std::endl;
+            return -1;
+        }
+        allIdentical = benchmarkFile(objPath, runs, numThreads, runLegacy, runOptimizer) && allIdentical;
+    }
+    for (unsigned int faceCount : faceCounts)
+    {
+        std::filesystem::path objPath = workDirectory / ("obj_load_benchmark_" + std::to_string(faceCount) + ".obj");
+        if (!writeSyntheticObj(objPath, faceCount))
+        {
+            std::cerr << "Could not write synthetic obj file at path: " << objPath << std::endl;
+            return -1;
+        }
+        allIdentical = benchmarkFile(objPath, runs, numThreads, runLegacy, runOptimizer) && allIdentical;
+
+        std::filesystem::remove(objPath);
+        std::filesystem::path mtlPath = objPath;
+        std::filesystem::remove(mtlPath.replace_extension(".mtl"));
+    }
+    return allIdentical ? 0 : 1;
+}
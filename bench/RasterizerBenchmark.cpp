@@ -0,0 +1,111 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <filesystem>
+#include "cyTriMesh.h"
+#include "cyMatrix.h"
+#include "lodepng.h"
+#include "MeshData.h"
+#include "SoftwareRasterizer.h"
+#include "DrawList.h"
+#include "SceneLayout.h"
+
+/* Camera and light orbit the mesh once over frameCount frames. The mesh is turned z up to y up like in GraphicsProject and scaled to unit radius. */
+RasterUniforms orbitUniforms(const MeshData& meshData, unsigned int frame, unsigned int frameCount, float aspect)
+{
+    float meshRadius = std::max((meshData.boundMax - meshData.boundMin).Length()/2, 1e-6f);
+    cy::Matrix4f modelMatrix = SceneLayout::ModelMatrix(meshData.boundMin, meshData.boundMax, 1.0f/meshRadius);
+
+    float angle = 2.0f*cy::Pi<float>()*frame/std::max(frameCount, 1u);
+    cy::Vec3f cameraPosition(1.6f*std::sin(angle), 0.5f, 1.6f*std::cos(angle));
+    cy::Vec3f lightPosition(3.0f*std::sin(-angle + 1.0f), 2.0f, 3.0f*std::cos(-angle + 1.0f));
+    cy::Matrix4f viewMatrix = cy::Matrix4f::View(cameraPosition, cy::Vec3f(0, 0, 0), cy::Vec3f(0, 1, 0));
+    cy::Matrix4f perspectiveMatrix = cy::Matrix4f::Perspective(75.0f*cy::Pi<float>()/180.0f, aspect, 0.1f, 1000.0f);
+
+    RasterUniforms uniforms;
+    uniforms.mvp = perspectiveMatrix * viewMatrix * modelMatrix;
+    uniforms.mv = viewMatrix * modelMatrix;
+    uniforms.mvNormal = cy::Matrix3f(viewMatrix * modelMatrix).GetInverse().GetTranspose();
+    uniforms.lightPosition = cy::Vec3f(viewMatrix * cy::Vec4f(lightPosition, 1.0f));
+    return uniforms;
+}
+
+/* Render frameCount frames on numThreads threads and return the frames per second. The first frame is kept in firstFrame. */
+double renderFrames(const MeshData& meshData, const std::vector<RasterDraw>& draws, unsigned int width, unsigned int height, unsigned int frameCount,
+                    unsigned int numThreads, std::vector<unsigned char>& firstFrame)
+{
+    SoftwareRasterizer rasterizer;
+    rasterizer.Resize(width, height, numThreads);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int frame = 0; frame < frameCount; frame++)
+    {
+        rasterizer.Clear(0, 0, 0);
+        RasterUniforms uniforms = orbitUniforms(meshData, frame, frameCount, static_cast<float>(width)/height);
+        rasterizer.DrawMesh(meshData, draws, uniforms);
+        if (frame == 0) { firstFrame = rasterizer.Color(); }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return frameCount / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    /* Parse Command Line Arguements */
+    std::filesystem::path objFilePath = "res/assets/teapot.obj";
+    std::string pngFilePath;
+    unsigned int width = 1280;
+    unsigned int height = 960;
+    unsigned int frameCount = 60;
+    unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) { frameCount = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--threads" && i + 1 < argc) { numThreads = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--width" && i + 1 < argc) { width = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--height" && i + 1 < argc) { height = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--png" && i + 1 < argc) { pngFilePath = argv[++i]; }
+        else if (arg[0] != '-') { objFilePath = arg; }
+        else
+        {
+            std::cerr << "Usage: RasterizerBenchmark [obj file] [--frames N] [--threads N] [--width W] [--height H] [--png path]" << std::endl;
+            return -1;
+        }
+    }
+
+    cy::TriMesh mesh;
+    MeshData meshData;
+    if (!mesh.LoadFromFileObj(objFilePath.string().c_str(), true, nullptr) || !meshData.BuildFromTriMesh(mesh))
+    {
+        std::cerr << "Could not load mesh with normals and uvs from obj file at path: " << objFilePath << std::endl;
+        return -1;
+    }
+
+    RasterTextureFiles textures(objFilePath, &std::cerr);
+    std::vector<RasterMaterial> materials = SoftwareRasterizer::MaterialsOf(meshData, [&](const char* textureName) { return textures.Get(textureName); });
+    std::vector<RasterDraw> draws = SoftwareRasterizer::DrawsOf(DrawList::MaterialRanges(meshData), materials);
+
+    printf("%s: %zu triangles in %zu draws at %ux%u, %u frames\n", objFilePath.string().c_str(), meshData.indexCount / 3, draws.size(), width, height, frameCount);
+    std::vector<unsigned char> serialFrame;
+    std::vector<unsigned char> parallelFrame;
+    double serialFps = renderFrames(meshData, draws, width, height, frameCount, 1, serialFrame);
+    printf("  %3u thread   %8.2f fps  %8.2f ms/frame\n", 1u, serialFps, 1000.0 / serialFps);
+    double parallelFps = renderFrames(meshData, draws, width, height, frameCount, numThreads, parallelFrame);
+    printf("  %3u threads  %8.2f fps  %8.2f ms/frame  (%.2fx)\n", numThreads, parallelFps, 1000.0 / parallelFps, parallelFps / serialFps);
+
+    // Tiles are independent and keep the draw order, so the image must not depend on the thread count
+    bool framesMatch = serialFrame == parallelFrame;
+    printf("  frames rendered on 1 and %u threads %s\n", numThreads, framesMatch ? "match" : "DIFFER");
+    if (!pngFilePath.empty())
+    {
+        unsigned pngLodeError = lodepng::encode(pngFilePath, parallelFrame, width, height);
+        if (pngLodeError) { std::cerr << "Could not write " << pngFilePath << ": " << lodepng_error_text(pngLodeError) << std::endl; return -1; }
+    }
+    return framesMatch ? 0 : 1;
+}
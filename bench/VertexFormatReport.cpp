@@ -0,0 +1,140 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include "cyTriMesh.h"
+#include "MeshData.h"
+#include "VertexFormat.h"
+
+/* Largest normal errors the octahedral encodings may have, a little above the measured maximum over the unit sphere */
+constexpr float OCTAHEDRAL16_MAX_DEGREES = 0.01f;
+constexpr float OCTAHEDRAL8_MAX_DEGREES = 0.75f;
+
+/* Encode evenly spread unit directions plus the axes and octant diagonals and return the largest angle error in degrees */
+float measureOctahedralError(int bits, unsigned int directionCount)
+{
+    std::vector<cy::Vec3f> directions;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        cy::Vec3f direction(0, 0, 0);
+        direction[axis] = 1.0f;
+        directions.push_back(direction);
+        directions.push_back(-direction);
+    }
+    for (int octant = 0; octant < 8; octant++)
+    {
+        directions.push_back(cy::Vec3f(octant & 1 ? -1.0f : 1.0f, octant & 2 ? -1.0f : 1.0f, octant & 4 ? -1.0f : 1.0f).GetNormalized());
+    }
+    // Fibonacci sphere
+    float goldenAngle = cy::Pi<float>() * (3.0f - std::sqrt(5.0f));
+    for (unsigned int i = 0; i < directionCount; i++)
+    {
+        float z = 1.0f - 2.0f*(i + 0.5f)/directionCount;
+        float radius = std::sqrt(1.0f - z*z);
+        float angle = goldenAngle*i;
+        directions.push_back(cy::Vec3f(radius*std::cos(angle), radius*std::sin(angle), z));
+    }
+
+    float maxDegrees = 0.0f;
+    for (const cy::Vec3f& direction : directions)
+    {
+        int16_t encoded[2];
+        VertexQuantizer::EncodeOctahedral(direction, bits, encoded);
+        maxDegrees = std::max(maxDegrees, VertexQuantizer::NormalErrorDegrees(direction, VertexQuantizer::DecodeOctahedral(encoded[0], encoded[1], bits)));
+    }
+    return maxDegrees;
+}
+
+/* Normals an obj file can hold that have no direction, NaN from "vn nan 0 0" and infinite or overflowing components, have to encode as +z */
+bool checkNonFiniteNormals()
+{
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    float infinity = std::numeric_limits<float>::infinity();
+    float largest = std::numeric_limits<float>::max();
+    cy::Vec3f normals[] = { cy::Vec3f(0, 0, 0), cy::Vec3f(nan, 0, 0), cy::Vec3f(0, nan, -1), cy::Vec3f(infinity, 0, 0),
+                            cy::Vec3f(0, -infinity, 0), cy::Vec3f(largest, largest, -largest) };
+    bool allAtZ = true;
+    for (int bits : { 16, 8 })
+    {
+        for (const cy::Vec3f& normal : normals)
+        {
+            int16_t encoded[2] = { 1234, -1234 };
+            VertexQuantizer::EncodeOctahedral(normal, bits, encoded);
+            if (encoded[0] != 0 || encoded[1] != 0)
+            {
+                printf("Normal (%g, %g, %g) encoded with %d bits as (%d, %d) instead of +z\n", normal.x, normal.y, normal.z, bits, encoded[0], encoded[1]);
+                allAtZ = false;
+            }
+        }
+    }
+    printf("Zero, NaN, and infinite normals: %s\n", allAtZ ? "encoded as +z" : "FAILED");
+    return allAtZ;
+}
+
+/* Report the error of every vertex format on one mesh and check it against the quantization step of each component */
+bool reportMesh(const std::filesystem::path& objPath)
+{
+    cy::TriMesh mesh;
+    MeshData meshData;
+    if (!mesh.LoadFromFileObj(objPath.string().c_str(), true, nullptr) || !meshData.BuildFromTriMesh(mesh))
+    {
+        std::cerr << "Could not load mesh with normals, uvs, and materials from obj file at path: " << objPath << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> stream;
+    VertexDecode decode = VertexQuantizer::Encode(meshData, VertexFormat::Compact16, stream);
+    // Rounding to the nearest of 65535 steps is off by at most half a step per axis, plus float rounding of the decode
+    float positionBound = (0.5f/65535.0f)*decode.positionScale.Length() + 1e-6f*(meshData.boundMax.Abs().Max() + 1.0f);
+    float uvBound = (0.5f/65535.0f)*decode.uvScale.Max() + 1e-6f*(decode.uvOffset.Abs().Max() + decode.uvScale.Max() + 1.0f);
+
+    printf("%s: %zu vertices, bounding box diagonal %g, uv extent %g\n", objPath.string().c_str(), meshData.vertexCount, decode.positionScale.Length(), decode.uvScale.Max());
+    printf("  %-10s  %6s  %10s  %12s  %12s  %10s\n", "format", "stride", "bytes", "position", "normal(deg)", "uv");
+    bool withinBounds = true;
+    for (VertexFormat format : { VertexFormat::Float32, VertexFormat::Compact16, VertexFormat::Compact8 })
+    {
+        QuantizationError error = VertexQuantizer::MeasureError(meshData, format);
+        float normalBound = format == VertexFormat::Float32 ? 0.0f : (format == VertexFormat::Compact16 ? OCTAHEDRAL16_MAX_DEGREES : OCTAHEDRAL8_MAX_DEGREES);
+        bool formatWithinBounds = error.position <= positionBound && error.uv <= uvBound && error.normalDegrees <= normalBound + 1e-3f;
+        printf("  %-10s  %6zu  %10zu  %12.3e  %12.3e  %10.3e  %s\n", VertexQuantizer::Name(format), VertexQuantizer::Stride(format),
+               VertexQuantizer::Stride(format)*meshData.vertexCount, error.position, error.normalDegrees, error.uv, formatWithinBounds ? "ok" : "OUT OF BOUNDS");
+        withinBounds = withinBounds && formatWithinBounds;
+    }
+    return withinBounds;
+}
+
+int main(int argc, char** argv)
+{
+    /* Parse Command Line Arguements */
+    std::vector<std::filesystem::path> objPaths;
+    unsigned int directionCount = 1000000;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--directions" && i + 1 < argc) { directionCount = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10)); }
+        else if (arg[0] != '-') { objPaths.push_back(arg); }
+        else
+        {
+            std::cerr << "Usage: VertexFormatReport [obj file...] [--directions N]" << std::endl;
+            return -1;
+        }
+    }
+    if (objPaths.empty()) { objPaths.push_back("res/assets/teapot.obj"); }
+
+    float octahedral16Degrees = measureOctahedralError(16, directionCount);
+    float octahedral8Degrees = measureOctahedralError(8, directionCount);
+    printf("Octahedral normals over %u directions: 2x16-bit max error %.3e deg (bound %.3e), 2x8-bit max error %.3e deg (bound %.3e)\n",
+           directionCount, octahedral16Degrees, OCTAHEDRAL16_MAX_DEGREES, octahedral8Degrees, OCTAHEDRAL8_MAX_DEGREES);
+    bool withinBounds = octahedral16Degrees <= OCTAHEDRAL16_MAX_DEGREES && octahedral8Degrees <= OCTAHEDRAL8_MAX_DEGREES;
+    withinBounds = checkNonFiniteNormals() && withinBounds;
+
+    for (const std::filesystem::path& objPath : objPaths)
+    {
+        withinBounds = reportMesh(objPath) && withinBounds;
+    }
+    return withinBounds ? 0 : 1;
+}
@@ -38,7 +38,16 @@
 
 #include "cyVector.h"
 #include <vector>
+#include <string>
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#if defined(__has_include)
+# if __has_include(<charconv>)
+#  include <charconv>
+# endif
+#endif
 
 //-------------------------------------------------------------------------------
 
@@ -181,7 +190,7 @@ public:
 	void ComputeNormals(bool clockwise=false);		//!< Computes and stores vertex normals
 
 	//!@name Load and Save methods
-	bool LoadFromFileObj( char const *filename, bool loadMtl=true, std::ostream *outStream=&std::cout );	//!< Loads the mesh from an OBJ file. Automatically converts all faces to triangles.
+	bool LoadFromFileObj( char const *filename, bool loadMtl=true, std::ostream *outStream=&std::cout, unsigned int numThreads=1 );	//!< Loads the mesh from an OBJ file. Automatically converts all faces to triangles. With numThreads other than 1 the file is parsed in chunks on multiple threads (0 uses all hardware threads); the result is identical to the serial parser.
 	bool SaveToFileObj( char const *filename, std::ostream *outStream );									//!< Saves the mesh to an OBJ file with the given name.
 
 private:
@@ -200,6 +209,18 @@ private:
 		MtlData() { faceCount=0; firstFace=0; }
 	};
 	struct MtlLibName { std::string filename; };
+
+	// OBJ parsing helpers
+	class  ObjBlockReader;
+	struct ObjChunk;
+	static bool        ObjIsSpace  ( char c ) { return c==' ' || c=='\t' || c=='\v' || c=='\f'; }
+	static bool        ObjIsLineEnd( char c ) { return c=='\n' || c=='\r' || c=='\0'; }
+	static char const* ObjSkipSpace( char const *s ) { while ( ObjIsSpace(*s) ) s++; return s; }
+	static char const* ObjReadFloat( char const *s, float &f );
+	static int         ObjReadFloats( char const *s, float *f, int n ) { int i=0; for ( ; i<n; i++ ) { s=ObjReadFloat(s,f[i]); if (!s) break; } return i; }
+	static void        ObjReadVertex( char const *s, Vec3f &v ) { v.Zero(); ObjReadFloats(s,&v.x,3); }
+	static std::string ObjArgument ( char const *s );
+	template <typename FUNC> static void ObjParallelFor( unsigned int n, unsigned int numThreads, FUNC func );
 };
 
 //-------------------------------------------------------------------------------
@@ -261,9 +282,239 @@ inline void TriMesh::ComputeNormals(bool clockwise)
 	for ( unsigned int i=0; i<nvn; i++ ) vn[i].Normalize();
 }
 
-inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::ostream *outStream )
+//-------------------------------------------------------------------------------
+
+//! Reads a file in large blocks that end at line boundaries.
+class TriMesh::ObjBlockReader
+{
+	FILE *fp;
+	std::vector<char> block;
+	size_t size;	// number of bytes in the block
+	size_t next;	// beginning of the partial line that is carried over to the next block
+	bool eof;
+public:
+	ObjBlockReader( FILE *file ) : fp(file), size(0), next(0), eof(false) {}
+	//! Reads at least blockSize bytes (unless the file ends) and returns the complete lines among them.
+	//! At the end of the file the block is followed by a null character. Returns false when there is nothing left to read.
+	bool ReadBlock( size_t blockSize, char* &begin, char* &end )
+	{
+		size_t n = size - next;
+		if ( next > 0 && n > 0 ) memmove( block.data(), block.data()+next, n );
+		size = n;
+		next = 0;
+		size_t target = blockSize;
+		size_t last = 0;
+		for (;;) {
+			while ( !eof && size < target ) {
+				size_t want = std::min( target-size, std::max( size, size_t(1)<<20 ) );	// grow the block geometrically up to the target size
+				if ( block.size() < size+want+1 ) block.resize( size+want+1 );
+				size_t r = fread( block.data()+size, 1, want, fp );
+				size += r;
+				if ( r < want ) eof = true;
+			}
+			last = size;
+			if ( eof ) break;
+			while ( last > 0 && !ObjIsLineEnd(block[last-1]) ) last--;
+			if ( last > 0 ) break;
+			target += blockSize;	// a single line is longer than the block
+		}
+		if ( eof ) {
+			if ( block.size() < size+1 ) block.resize( size+1 );
+			block[size] = '\0';
+		}
+		next  = last;
+		begin = block.data();
+		end   = block.data() + last;
+		return last > 0;
+	}
+};
+
+//! Geometry parsed from a range of lines. Face indices are global, except the negative (relative) ones,
+//! which are relative to the beginning of the chunk until the chunks are merged.
+struct TriMesh::ObjChunk
+{
+	std::vector<Vec3f>   v, vt, vn;
+	std::vector<TriFace> f, ft, fn;			// texture and normal faces are kept for every face
+	std::vector<int>     faceMtl;			// usemtl command of each face, -1 for faces that keep the material of the previous chunk
+	std::vector<size_t>  relative;			// (face*3+corner)*4+type of each index that is relative to the chunk
+	std::vector<std::pair<unsigned int,std::string>> usemtl;	// first face and material name of each usemtl command
+	std::vector<std::string> mtllib;		// mtllib file names
+	unsigned int firstFT = ~0u;				// first face that is stored after texture data appears
+	unsigned int firstFN = ~0u;				// first face that is stored after normal data appears
+	bool hasTextures = false;				// parsing state, kept when the chunk continues with the next block
+	bool hasNormals  = false;
+	int  currentMtl  = -1;
+
+	void Parse( char *begin, char *end, bool loadMtl );	//!< Parses the lines in [begin,end) and appends them to the chunk
+
+};
+
+template <typename FUNC>
+inline void TriMesh::ObjParallelFor( unsigned int n, unsigned int numThreads, FUNC func )
+{
+	if ( numThreads > n ) numThreads = n;
+	if ( numThreads <= 1 ) { for ( unsigned int i=0; i<n; i++ ) func(i); return; }
+	std::atomic<unsigned int> counter(0);
+	auto worker = [&]() { for ( unsigned int i=counter++; i<n; i=counter++ ) func(i); };
+	std::vector<std::thread> threads;
+	for ( unsigned int t=1; t<numThreads; t++ ) threads.emplace_back(worker);
+	worker();
+	for ( std::thread &t : threads ) t.join();
+}
+
+inline char const* TriMesh::ObjReadFloat( char const *s, float &f )
+{
+	s = ObjSkipSpace(s);
+	if ( *s == '+' && s[1] != '-' ) s++;
+#if defined(__cpp_lib_to_chars)
+	char const *e = s;
+	while ( *e!='\0' && !ObjIsSpace(*e) ) e++;
+	std::from_chars_result r = std::from_chars( s, e, f );
+	if ( r.ptr == s ) return nullptr;
+	if ( r.ec == std::errc::result_out_of_range ) f = (float) strtod( s, nullptr );
+	return r.ptr;
+#else
+	char *e;
+	float r = strtof( s, &e );
+	if ( e == s ) return nullptr;
+	f = r;
+	return e;
+#endif
+}
+
+inline std::string TriMesh::ObjArgument( char const *s )
+{
+	// leading and trailing white space is removed and internal white space is collapsed to a single space
+	std::string arg;
+	s = ObjSkipSpace(s);
+	while ( *s ) {
+		if ( ObjIsSpace(*s) ) {
+			s = ObjSkipSpace(s);
+			if ( *s ) arg.push_back(' ');
+		} else arg.push_back(*s++);
+	}
+	return arg;
+}
+
+inline void TriMesh::ObjChunk::Parse( char *begin, char *end, bool loadMtl )
+{
+	auto PushFace = [&]( TriFace const &face, TriFace const &textureFace, TriFace const &normalFace, unsigned int const relMask[3] ) {
+		size_t fi = f.size();
+		for ( int t=0; t<3; t++ ) {
+			for ( int j=0; j<3; j++ ) if ( relMask[t] & (1u<<j) ) relative.push_back( (fi*3+j)*4+t );
+		}
+		if ( hasTextures && firstFT == ~0u ) firstFT = (unsigned int)fi;
+		if ( hasNormals  && firstFN == ~0u ) firstFN = (unsigned int)fi;
+		f .push_back(face);
+		ft.push_back(textureFace);
+		fn.push_back(normalFace);
+		faceMtl.push_back(currentMtl);
+	};
+
+	for ( char *next=begin; next<end; ) {
+		char *line = next;
+		char *lineEnd = line;
+		while ( !ObjIsLineEnd(*lineEnd) ) lineEnd++;
+		*lineEnd = '\0';
+		next = lineEnd + 1;
+		line = const_cast<char*>( ObjSkipSpace(line) );
+		if ( *line == '\0' || *line == '#' ) continue;
+
+		// split the command from its arguments
+		char const *args = line;
+		while ( *args!='\0' && !ObjIsSpace(*args) ) args++;
+		size_t cmdLen = size_t(args - line);
+		auto IsCommand = [&]( char const *cmd, size_t n ) { return cmdLen==n && strncmp(line,cmd,n)==0; };
+
+		if ( IsCommand("v",1) ) {
+			Vec3f vertex;
+			ObjReadVertex(args,vertex);
+			v.push_back(vertex);
+		}
+		else if ( IsCommand("vt",2) ) {
+			Vec3f texVert;
+			ObjReadVertex(args,texVert);
+			vt.push_back(texVert);
+			hasTextures = true;
+		}
+		else if ( IsCommand("vn",2) ) {
+			Vec3f normal;
+			ObjReadVertex(args,normal);
+			vn.push_back(normal);
+			hasNormals = true;
+		}
+		else if ( IsCommand("f",1) ) {
+			int facevert = -1;
+			bool inspace = true;
+			bool negative = false;
+			int type = 0;
+			unsigned int index;
+			TriFace face, textureFace, normalFace;
+			unsigned int relMask[3] = { 0, 0, 0 };	// corners of face, textureFace, and normalFace with relative indices
+			for ( char const *c=args; *c!='\0'; c++ ) {
+				if ( ObjIsSpace(*c) ) inspace = true;
+				else {
+					if ( inspace ) {
+						inspace=false;
+						negative = false;
+						type=0;
+						index=0;
+						switch ( facevert ) {
+							case -1:
+								// initialize face
+								face.v[0] = face.v[1] = face.v[2] = 0;
+								textureFace.v[0] = textureFace.v[1] = textureFace.v[2] = 0;
+								normalFace. v[0] = normalFace. v[1] = normalFace. v[2] = 0;
+								// fall through
+							case 0:
+							case 1:
+								facevert++;
+								break;
+							case 2:
+								// copy the first two vertices from the previous face
+								PushFace(face,textureFace,normalFace,relMask);
+								face.v[1] = face.v[2];
+								textureFace.v[1] = textureFace.v[2];
+								normalFace.v[1] = normalFace.v[2];
+								for ( int t=0; t<3; t++ ) relMask[t] = (relMask[t] & 5u) | ((relMask[t] & 4u) >> 1);
+								break;
+						}
+					}
+					if ( *c == '/' ) { type++; index=0; }
+					if ( *c == '-' ) negative = true;
+					if ( *c >= '0' && *c <= '9' ) {
+						index = index*10 + (*c-'0');
+						switch ( type ) {
+							case 0: face.v       [facevert] = negative ? (unsigned int)v. size()-index : index-1; break;
+							case 1: textureFace.v[facevert] = negative ? (unsigned int)vt.size()-index : index-1; hasTextures=true; break;
+							case 2: normalFace.v [facevert] = negative ? (unsigned int)vn.size()-index : index-1; hasNormals =true; break;
+						}
+						if ( type < 3 ) {
+							if ( negative ) relMask[type] |= 1u<<facevert;
+							else relMask[type] &= ~(1u<<facevert);
+						}
+					}
+				}
+			}
+			PushFace(face,textureFace,normalFace,relMask);
+		}
+		else if ( loadMtl ) {
+			if ( IsCommand("usemtl",6) ) {
+				currentMtl = (int)usemtl.size();
+				usemtl.emplace_back( (unsigned int)f.size(), ObjArgument(args) );
+			}
+			if ( IsCommand("mtllib",6) ) {
+				mtllib.push_back( ObjArgument(args) );
+			}
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------
+
+inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::ostream *outStream, unsigned int numThreads )
 {
-	FILE *fp = fopen(filename,"r");
+	FILE *fp = fopen(filename,"rb");
 	if ( !fp ) {
 		if ( outStream ) *outStream << "ERROR: Cannot open file " << filename << std::endl;
 		return false;
@@ -347,123 +598,110 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 	};
 	MtlList mtlList;
 
-	std::vector<Vec3f>      _v;		// vertices
 	std::vector<TriFace>    _f;		// faces
-	std::vector<Vec3f>      _vn;	// vertex normal
 	std::vector<TriFace>    _fn;	// normal faces
-	std::vector<Vec3f>      _vt;	// texture vertices
 	std::vector<TriFace>    _ft;	// texture faces
 	std::vector<MtlLibName> mtlFiles;
 	std::vector<int>        faceMtlIndex;
 
-	int currentMtlIndex = -1;
-	bool hasTextures=false, hasNormals=false;
-
-	while ( int rb = buffer.ReadLine(fp) ) {
-		if ( buffer.IsCommand("v") ) {
-			Vec3f vertex;
-			buffer.ReadVertex(vertex);
-			_v.push_back(vertex);
+	// Parse the file in blocks of complete lines. With multiple threads, each block is split into one chunk per thread.
+	if ( numThreads == 0 ) numThreads = std::max( 1u, std::thread::hardware_concurrency() );
+	std::vector<ObjChunk> chunks;
+	if ( numThreads == 1 ) chunks.resize(1);
+	ObjBlockReader reader(fp);
+	size_t const chunkSize = size_t(8) << 20;
+	char *blockBegin, *blockEnd;
+	while ( reader.ReadBlock( numThreads==1 ? size_t(1)<<20 : chunkSize*numThreads, blockBegin, blockEnd ) ) {
+		if ( numThreads == 1 ) { chunks[0].Parse(blockBegin,blockEnd,loadMtl); continue; }
+		std::vector<char*> bounds(1,blockBegin);
+		for ( unsigned int i=1; i<numThreads; i++ ) {
+			char *b = std::max( bounds.back(), blockBegin + size_t(blockEnd-blockBegin)*i/numThreads );
+			while ( b < blockEnd && !ObjIsLineEnd(*b) ) b++;
+			if ( b < blockEnd ) b++;
+			bounds.push_back(b);
 		}
-		else if ( buffer.IsCommand("vt") ) {
-			Vec3f texVert;
-			buffer.ReadVertex(texVert);
-			_vt.push_back(texVert);
-			hasTextures = true;
-		}
-		else if ( buffer.IsCommand("vn") ) {
-			Vec3f normal;
-			buffer.ReadVertex(normal);
-			_vn.push_back(normal);
-			hasNormals = true;
-		}
-		else if ( buffer.IsCommand("f") ) {
-			int facevert = -1;
-			bool inspace = true;
-			bool negative = false;
-			int type = 0;
-			unsigned int index;
-			TriFace face, textureFace, normalFace;
-			unsigned int nFacesBefore = (unsigned int)_f.size();
-			for ( int i=2; i<rb; i++ ) {
-				if ( buffer[i] == ' ' ) inspace = true;
-				else {
-					if ( inspace ) {
-						inspace=false;
-						negative = false;
-						type=0;
-						index=0;
-						switch ( facevert ) {
-							case -1:
-								// initialize face
-								face.v[0] = face.v[1] = face.v[2] = 0;
-								textureFace.v[0] = textureFace.v[1] = textureFace.v[2] = 0;
-								normalFace. v[0] = normalFace. v[1] = normalFace. v[2] = 0;
-							case 0:
-							case 1:
-								facevert++;
-								break;
-							case 2:
-								// copy the first two vertices from the previous face
-								_f.push_back(face);
-								face.v[1] = face.v[2];
-								if ( hasTextures ) {
-									_ft.push_back(textureFace);
-									textureFace.v[1] = textureFace.v[2];
-								}
-								if ( hasNormals ) {
-									_fn.push_back(normalFace);
-									normalFace.v[1] = normalFace.v[2];
-								}
-								faceMtlIndex.push_back(currentMtlIndex);
-								break;
-						}
-					}
-					if ( buffer[i] == '/' ) { type++; index=0; }
-					if ( buffer[i] == '-' ) negative = true;
-					if ( buffer[i] >= '0' && buffer[i] <= '9' ) {
-						index = index*10 + (buffer[i]-'0');
-						switch ( type ) {
-							case 0: face.v       [facevert] = negative ? (unsigned int)_v. size()-index : index-1; break;
-							case 1: textureFace.v[facevert] = negative ? (unsigned int)_vt.size()-index : index-1; hasTextures=true; break;
-							case 2: normalFace.v [facevert] = negative ? (unsigned int)_vn.size()-index : index-1; hasNormals =true; break;
-						}
-					}
-				}
-			}
-			_f.push_back(face);
-			if ( hasTextures ) _ft.push_back(textureFace);
-			if ( hasNormals  ) _fn.push_back(normalFace);
-			faceMtlIndex.push_back(currentMtlIndex);
-			if ( currentMtlIndex>=0 ) mtlList.mtlData[currentMtlIndex].faceCount += (unsigned int)_f.size() - nFacesBefore;
-		}
-		else if ( loadMtl ) {
-			if ( buffer.IsCommand("usemtl") ) {
-				currentMtlIndex = mtlList.CreateMtl(buffer.Data(7), (unsigned int)_f.size());
-			}
-			if ( buffer.IsCommand("mtllib") ) {
-				MtlLibName libName;
-				libName.filename = buffer.Data(7);
-				mtlFiles.push_back(libName);
-			}
-		}
-		if ( feof(fp) ) break;
+		bounds.push_back(blockEnd);
+		size_t firstChunk = chunks.size();
+		chunks.resize( firstChunk + numThreads );
+		ObjParallelFor( numThreads, numThreads, [&]( unsigned int i ) { chunks[firstChunk+i].Parse(bounds[i],bounds[i+1],loadMtl); } );
 	}
 
 	fclose(fp);
 
+	// Find where each chunk starts in the merged data
+	size_t numChunks = chunks.size();
+	std::vector<unsigned int> vBase(numChunks+1,0), vtBase(numChunks+1,0), vnBase(numChunks+1,0), fBase(numChunks+1,0);
+	unsigned int firstFT = ~0u, firstFN = ~0u;
+	for ( size_t c=0; c<numChunks; c++ ) {
+		ObjChunk const &chunk = chunks[c];
+		vBase [c+1] = vBase [c] + (unsigned int)chunk.v .size();
+		vtBase[c+1] = vtBase[c] + (unsigned int)chunk.vt.size();
+		vnBase[c+1] = vnBase[c] + (unsigned int)chunk.vn.size();
+		fBase [c+1] = fBase [c] + (unsigned int)chunk.f .size();
+		if ( firstFT == ~0u && chunk.firstFT != ~0u ) firstFT = fBase[c] + chunk.firstFT;
+		if ( firstFN == ~0u && chunk.firstFN != ~0u ) firstFN = fBase[c] + chunk.firstFN;
+	}
+	unsigned int numFaces = fBase[numChunks];
+
+	// Resolve the materials in file order
+	std::vector<int> chunkStartMtl(numChunks);
+	std::vector<std::vector<int>> usemtlIndex(numChunks);
+	int currentMtlIndex = -1;
+	for ( size_t c=0; c<numChunks; c++ ) {
+		ObjChunk const &chunk = chunks[c];
+		chunkStartMtl[c] = currentMtlIndex;
+		unsigned int faceBegin = 0;
+		for ( size_t e=0; e<chunk.usemtl.size(); e++ ) {
+			if ( currentMtlIndex >= 0 ) mtlList.mtlData[currentMtlIndex].faceCount += chunk.usemtl[e].first - faceBegin;
+			currentMtlIndex = mtlList.CreateMtl( chunk.usemtl[e].second.c_str(), fBase[c] + chunk.usemtl[e].first );
+			usemtlIndex[c].push_back(currentMtlIndex);
+			faceBegin = chunk.usemtl[e].first;
+		}
+		if ( currentMtlIndex >= 0 ) mtlList.mtlData[currentMtlIndex].faceCount += (unsigned int)chunk.f.size() - faceBegin;
+		for ( std::string const &name : chunk.mtllib ) {
+			MtlLibName libName;
+			libName.filename = name;
+			mtlFiles.push_back(libName);
+		}
+	}
 
-	if ( _f.size() == 0 ) return true; // No faces found
-	SetNumVertex((unsigned int)_v.size());
-	SetNumFaces((unsigned int)_f.size());
-	SetNumTexVerts((unsigned int)_vt.size());
-	SetNumNormals((unsigned int)_vn.size());
+	if ( numFaces == 0 ) return true; // No faces found
+	SetNumVertex(vBase[numChunks]);
+	SetNumFaces(numFaces);
+	SetNumTexVerts(vtBase[numChunks]);
+	SetNumNormals(vnBase[numChunks]);
 	if ( loadMtl ) SetNumMtls((unsigned int)mtlList.mtlData.size());
 
-	// Copy data
-	memcpy(v, _v.data(), sizeof(Vec3f)*_v.size());
-	if ( _vt.size() > 0 ) memcpy(vt, _vt.data(), sizeof(Vec3f)*_vt.size());
-	if ( _vn.size() > 0 ) memcpy(vn, _vn.data(), sizeof(Vec3f)*_vn.size());
+	// Merge the chunks. Texture and normal faces are only stored from the first face after texture/normal data appears.
+	_f.resize(numFaces);
+	_ft.resize( firstFT == ~0u ? 0 : numFaces - firstFT );
+	_fn.resize( firstFN == ~0u ? 0 : numFaces - firstFN );
+	faceMtlIndex.resize(numFaces);
+	ObjParallelFor( (unsigned int)numChunks, numThreads, [&]( unsigned int c ) {
+		ObjChunk &chunk = chunks[c];
+		std::vector<TriFace> *faces[3] = { &chunk.f, &chunk.ft, &chunk.fn };
+		unsigned int base[3] = { vBase[c], vtBase[c], vnBase[c] };
+		for ( size_t r : chunk.relative ) (*faces[r&3])[r/12].v[(r/4)%3] += base[r&3];
+
+		if ( !chunk.v .empty() ) memcpy( v  + vBase [c], chunk.v .data(), sizeof(Vec3f)*chunk.v .size() );
+		if ( !chunk.vt.empty() ) memcpy( vt + vtBase[c], chunk.vt.data(), sizeof(Vec3f)*chunk.vt.size() );
+		if ( !chunk.vn.empty() ) memcpy( vn + vnBase[c], chunk.vn.data(), sizeof(Vec3f)*chunk.vn.size() );
+
+		unsigned int fb = fBase[c], fe = fBase[c+1];
+		if ( fe > fb ) memcpy( _f.data() + fb, chunk.f.data(), sizeof(TriFace)*(fe-fb) );
+		auto CopySuffix = []( std::vector<TriFace> &to, std::vector<TriFace> const &from, unsigned int first, unsigned int fb, unsigned int fe ) {
+			if ( first == ~0u || fe <= first ) return;
+			unsigned int b = std::max(fb,first);
+			memcpy( to.data() + (b-first), from.data() + (b-fb), sizeof(TriFace)*(fe-b) );
+		};
+		CopySuffix( _ft, chunk.ft, firstFT, fb, fe );
+		CopySuffix( _fn, chunk.fn, firstFN, fb, fe );
+		for ( unsigned int i=fb; i<fe; i++ ) {
+			int e = chunk.faceMtl[i-fb];
+			faceMtlIndex[i] = e < 0 ? chunkStartMtl[c] : usemtlIndex[c][e];
+		}
+		chunk = ObjChunk();
+	} );
 
 	if ( mtlList.mtlData.size() > 0 ) {
 		unsigned int fid = 0;
@@ -4,18 +4,40 @@ uniform sampler2D mapKd;
 uniform sampler2D mapKs;
 uniform sampler2D mapKa;
 
-uniform vec3 mtl_Kd;
-uniform vec3 mtl_Ks;
-uniform vec3 mtl_Ka;
-uniform float mtl_Ns;
+// Constants of every material, MaterialConstants in DrawList.h. Bits of textureMask choose the texture over the constant color.
+struct Material
+{
+    vec4 Ka;
+    vec4 Kd;
+    vec4 Ks;
+    float Ns;
+    uint textureMask;
+};
+const uint MAP_KD = 1u;
+const uint MAP_KS = 2u;
+const uint MAP_KA = 4u;
+
+layout (std430, binding = 0) readonly buffer MaterialBuffer
+{
+    Material materials[];
+};
+uniform int materialIndex;
 
-uniform vec3 lightPosition;
-uniform float lightIntensity;
-uniform float lightAmbientIntensity;
+// Shared by every draw of a frame, FrameUniforms in FrameUniforms.h
+layout (std140, binding = 0) uniform FrameUniforms
+{
+    mat4 viewProjection;
+    mat4 view;
+    mat4 model;
+    mat3 modelNormal;
+    vec3 lightPosition;
+    float lightIntensity;
+    float lightAmbientIntensity;
+};
 
 in vec3 vPosition;
 in vec3 vNormal;
-in vec3 vUv;
+in vec2 vUv;
 
 out vec4 fColor;
 
@@ -23,9 +45,10 @@ void main()
 {
     vec3 normal = normalize(vNormal);
 
-    vec3 Kd = texture(mapKd, vUv.xy).rgb;
-    vec3 Ks = texture(mapKs, vUv.xy).rgb;
-    vec3 Ka = texture(mapKa, vUv.xy).rgb;
+    Material material = materials[materialIndex];
+    vec3 Kd = (material.textureMask & MAP_KD) != 0u ? texture(mapKd, vUv).rgb : material.Kd.rgb;
+    vec3 Ks = (material.textureMask & MAP_KS) != 0u ? texture(mapKs, vUv).rgb : material.Ks.rgb;
+    vec3 Ka = (material.textureMask & MAP_KA) != 0u ? texture(mapKa, vUv).rgb : material.Ka.rgb;
 
     vec3 lightDir = normalize(lightPosition - vPosition);
     vec3 viewDirection = normalize(-vPosition);
@@ -39,7 +62,7 @@ void main()
     vec3 litColorDirect = vec3(0, 0, 0);
     if (!inShadow)
     {
-        litColorDirect = lightIntensity * (geometryTerm*Kd + Ks*pow(specularTerm, mtl_Ns));
+        litColorDirect = lightIntensity * (geometryTerm*Kd + Ks*pow(specularTerm, material.Ns));
     }
 
     vec3 litColorIndirect = lightAmbientIntensity * Ka;
@@ -1,23 +1,71 @@
 #version 430 core
 
-uniform mat4 mvp;
-uniform mat4 mv;
-uniform mat3 mvNormal;
+// Shared by every draw of a frame, FrameUniforms in FrameUniforms.h
+layout (std140, binding = 0) uniform FrameUniforms
+{
+    mat4 viewProjection;
+    mat4 view;
+    mat4 model;
+    mat3 modelNormal;
+    vec3 lightPosition;
+    float lightIntensity;
+    float lightAmbientIntensity;
+};
+
+// Compact vertex formats store positions and uvs as 16-bit fractions of their bounds and normals octahedral encoded
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec2 uvOffset;
+uniform vec2 uvScale;
+uniform bool octahedralNormals;
 
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aUv;
+layout (location = 2) in vec2 aUv;
+
+// Per-instance placement, InstanceTransform in SceneLayout.h
+layout (location = 3) in vec4 aInstanceTranslationScale;
+layout (location = 4) in vec4 aInstanceRotation;
 
 out vec3 vPosition;
 out vec3 vNormal;
 out vec3 vLightPositionWorld;
-out vec3 vUv;
+out vec2 vUv;
+
+mat3 quaternionToMatrix(vec4 q)
+{
+    return mat3(
+        1.0 - 2.0*(q.y*q.y + q.z*q.z), 2.0*(q.x*q.y + q.w*q.z), 2.0*(q.x*q.z - q.w*q.y),
+        2.0*(q.x*q.y - q.w*q.z), 1.0 - 2.0*(q.x*q.x + q.z*q.z), 2.0*(q.y*q.z + q.w*q.x),
+        2.0*(q.x*q.z + q.w*q.y), 2.0*(q.y*q.z - q.w*q.x), 1.0 - 2.0*(q.x*q.x + q.y*q.y));
+}
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normal;
+}
 
 void main()
 {
-    vUv = aUv;
+    vec3 position = positionOffset + aPosition * positionScale;
+    vec3 normal = octahedralNormals ? decodeOctahedral(aNormal.xy) : aNormal;
+    vUv = uvOffset + aUv * uvScale;
     
-    vPosition = vec3( (mv * vec4(aPosition, 1.0)) );
-    vNormal = normalize(mvNormal * aNormal);
-    gl_Position = mvp * vec4(aPosition, 1.0);
+    mat3 instanceRotation = quaternionToMatrix(aInstanceRotation);
+    float instanceScale = aInstanceTranslationScale.w;
+    mat4 instanceMatrix = mat4(
+        vec4(instanceRotation[0]*instanceScale, 0.0),
+        vec4(instanceRotation[1]*instanceScale, 0.0),
+        vec4(instanceRotation[2]*instanceScale, 0.0),
+        vec4(aInstanceTranslationScale.xyz, 1.0));
+    vec4 worldPosition = instanceMatrix * model * vec4(position, 1.0);
+
+    // The uniform instance scale does not change normal directions
+    vPosition = vec3(view * worldPosition);
+    vNormal = normalize(mat3(view) * instanceRotation * modelNormal * normal);
+    gl_Position = viewProjection * worldPosition;
 }
\ No newline at end of file
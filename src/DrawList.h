@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <vector>
+#include "MeshData.h"
+
+/* One material in the std430 layout of the Material struct in fragShader.frag */
+struct MaterialConstants
+{
+    static constexpr uint32_t MAP_KD = 1u << 0;
+    static constexpr uint32_t MAP_KS = 1u << 1;
+    static constexpr uint32_t MAP_KA = 1u << 2;
+
+    float Ka[4];
+    float Kd[4];
+    float Ks[4];
+    float Ns;
+    uint32_t textureMask;  // MAP_* bits of the textures that replace the constant colors
+    float padding[2];
+};
+static_assert(sizeof(MaterialConstants) == 64, "MaterialConstants must match the std430 array stride of fragShader.frag");
+
+/* Index range drawn with one material. Faces outside every material use the material after the last one. */
+struct MaterialRange
+{
+    uint32_t materialIndex;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+/* One draw call with the program and the mapKd, mapKs, and mapKa textures it needs, 0 for none, and the run of instances it draws */
+struct DrawCommand
+{
+    static constexpr int TEXTURE_SLOTS = 3;
+
+    uint32_t program = 0;
+    uint32_t textures[TEXTURE_SLOTS] = { 0, 0, 0 };
+    uint32_t materialIndex = 0;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    uint32_t firstInstance = 0;
+    uint32_t instanceCount = 1;
+};
+
+/* Draw calls and state changes of one frame */
+struct FrameCounters
+{
+    unsigned int drawCalls = 0;
+    unsigned int programBinds = 0;
+    unsigned int textureBinds = 0;
+
+    unsigned int StateChanges() const { return programBinds + textureBinds; }
+    bool operator==(const FrameCounters& other) const { return drawCalls == other.drawCalls && programBinds == other.programBinds && textureBinds == other.textureBinds; }
+    bool operator!=(const FrameCounters& other) const { return !(*this == other); }
+};
+
+/* Draw commands sorted by program and then by textures, submitted with every redundant bind skipped */
+class DrawList {
+    public:
+        std::vector<DrawCommand> commands;
+
+        /* Every material range of meshData and the gaps between them, clamped to the index buffer */
+        static std::vector<MaterialRange> MaterialRanges(const MeshData& meshData)
+        {
+            std::vector<MaterialRange> ranges;
+            uint32_t defaultMaterial = static_cast<uint32_t>(meshData.materialCount);
+            size_t rangeStart = 0;
+            std::vector<MaterialRange> materialRanges;
+            for (size_t m = 0; m < meshData.materialCount; m++)
+            {
+                size_t first = std::min<size_t>(meshData.materials[m].firstIndex, meshData.indexCount);
+                size_t count = std::min<size_t>(meshData.materials[m].indexCount, meshData.indexCount - first);
+                if (count > 0) { materialRanges.push_back({ static_cast<uint32_t>(m), static_cast<uint32_t>(first), static_cast<uint32_t>(count) }); }
+            }
+            std::sort(materialRanges.begin(), materialRanges.end(), [](const MaterialRange& a, const MaterialRange& b) { return a.firstIndex < b.firstIndex; });
+            for (const MaterialRange& range : materialRanges)
+            {
+                if (range.firstIndex > rangeStart) { ranges.push_back({ defaultMaterial, static_cast<uint32_t>(rangeStart), static_cast<uint32_t>(range.firstIndex - rangeStart) }); }
+                ranges.push_back(range);
+                rangeStart = std::max<size_t>(rangeStart, static_cast<size_t>(range.firstIndex) + range.indexCount);
+            }
+            if (meshData.indexCount > rangeStart) { ranges.push_back({ defaultMaterial, static_cast<uint32_t>(rangeStart), static_cast<uint32_t>(meshData.indexCount - rangeStart) }); }
+            return ranges;
+        }
+
+        /* Constants of every material followed by the default material of faces outside them. hasTexture(m, MAP_*) tells which textures were loaded. */
+        template <typename HasTextureFunc>
+        static std::vector<MaterialConstants> MaterialConstantsOf(const MeshData& meshData, HasTextureFunc hasTexture)
+        {
+            std::vector<MaterialConstants> constants(meshData.materialCount + 1);
+            for (size_t m = 0; m < meshData.materialCount; m++)
+            {
+                const MeshMaterial& material = meshData.materials[m];
+                MaterialConstants& materialConstants = constants[m];
+                memset(&materialConstants, 0, sizeof(MaterialConstants));
+                memcpy(materialConstants.Ka, material.Ka, sizeof(material.Ka));
+                memcpy(materialConstants.Kd, material.Kd, sizeof(material.Kd));
+                memcpy(materialConstants.Ks, material.Ks, sizeof(material.Ks));
+                materialConstants.Ns = material.Ns;
+                for (uint32_t map : { MaterialConstants::MAP_KD, MaterialConstants::MAP_KS, MaterialConstants::MAP_KA })
+                {
+                    if (hasTexture(m, map)) { materialConstants.textureMask |= map; }
+                }
+            }
+            MaterialConstants& defaultConstants = constants.back();
+            memset(&defaultConstants, 0, sizeof(MaterialConstants));
+            for (int c = 0; c < 3; c++) { defaultConstants.Ka[c] = defaultConstants.Kd[c] = 0.8f; }
+            defaultConstants.Ns = 1.0f;
+            return constants;
+        }
+
+        /* Order by program, then by textures, then by position in the index buffer */
+        void Sort()
+        {
+            std::stable_sort(commands.begin(), commands.end(), [](const DrawCommand& a, const DrawCommand& b)
+            {
+                return std::tie(a.program, a.textures[0], a.textures[1], a.textures[2], a.firstIndex)
+                    < std::tie(b.program, b.textures[0], b.textures[1], b.textures[2], b.firstIndex);
+            });
+        }
+
+        /* Calls bindProgram(program) and bindTexture(slot, texture) only when the bound one changes, then draw(command) for every command.
+           Nothing is assumed to be bound when it starts. */
+        template <typename BindProgramFunc, typename BindTextureFunc, typename DrawFunc>
+        FrameCounters Submit(BindProgramFunc bindProgram, BindTextureFunc bindTexture, DrawFunc draw) const
+        {
+            FrameCounters counters;
+            bool programIsBound = false;
+            uint32_t boundProgram = 0;
+            bool textureIsBound[DrawCommand::TEXTURE_SLOTS] = {};
+            uint32_t boundTextures[DrawCommand::TEXTURE_SLOTS] = {};
+            for (const DrawCommand& command : commands)
+            {
+                if (!programIsBound || command.program != boundProgram)
+                {
+                    bindProgram(command.program);
+                    programIsBound = true;
+                    boundProgram = command.program;
+                    counters.programBinds++;
+                    // Texture units are shared between programs, the bound textures stay valid
+                }
+                for (int slot = 0; slot < DrawCommand::TEXTURE_SLOTS; slot++)
+                {
+                    // A material without the texture never samples it, so whatever is bound can stay
+                    if (command.textures[slot] == 0 || (textureIsBound[slot] && command.textures[slot] == boundTextures[slot])) { continue; }
+                    bindTexture(slot, command.textures[slot]);
+                    textureIsBound[slot] = true;
+                    boundTextures[slot] = command.textures[slot];
+                    counters.textureBinds++;
+                }
+                draw(command);
+                counters.drawCalls++;
+            }
+            return counters;
+        }
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <vector>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+#include "Profiler.h"
+
+/* What one run over a mesh measured: its size, the load times, the peak resident memory, and the frame statistics in milliseconds.
+   Statistics without samples are left out of the report, as is an empty image hash. */
+struct FrameReportMesh
+{
+    std::string name;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    size_t triangleCount = 0;
+    size_t vertexCount = 0;
+    size_t instanceCount = 1;
+    size_t drawCount = 0;
+    double meshMilliseconds = 0.0;
+    double textureMilliseconds = 0.0;
+    double uploadMilliseconds = 0.0;
+    double totalMilliseconds = 0.0;
+    uint64_t peakResidentBytes = 0;
+    FrameStatistics frameTimes;
+    FrameStatistics cpuUpdateTimes;
+    FrameStatistics cpuDrawTimes;
+    FrameStatistics gpuDrawTimes;
+    std::string imageHash;
+};
+
+/* The JSON results of GraphicsProject --orbit --results and FrameBenchmark, one document with an array of meshes.
+   The meshes are written last, so FrameBenchmark can collect the meshes of the GraphicsProject runs into its own document. */
+class FrameReport {
+    public:
+        /* Linux tracks the peak resident set size since it was last reset through /proc, elsewhere the peak of the whole process is reported */
+        static void ResetPeakResidentBytes()
+        {
+#if defined(__linux__)
+            std::ofstream clearRefs("/proc/self/clear_refs");
+            clearRefs << "5";
+#endif
+        }
+
+        static uint64_t PeakResidentBytes()
+        {
+#if defined(_WIN32)
+            PROCESS_MEMORY_COUNTERS counters;
+            return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+#if defined(__linux__)
+            std::ifstream status("/proc/self/status");
+            std::string line;
+            while (std::getline(status, line))
+            {
+                if (line.compare(0, 6, "VmHWM:") == 0) { return std::strtoull(line.c_str() + 6, nullptr, 10)*1024; }
+            }
+#endif
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+#if defined(__APPLE__)
+            return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+            return static_cast<uint64_t>(usage.ru_maxrss)*1024;
+#endif
+#endif
+        }
+
+        /* One element of the meshes array */
+        static std::string MeshJson(const FrameReportMesh& mesh)
+        {
+            std::vector<std::string> fields;
+            fields.push_back("\"name\": \"" + escape(mesh.name) + "\"");
+            fields.push_back("\"width\": " + std::to_string(mesh.width));
+            fields.push_back("\"height\": " + std::to_string(mesh.height));
+            fields.push_back("\"triangles\": " + std::to_string(mesh.triangleCount));
+            fields.push_back("\"vertices\": " + std::to_string(mesh.vertexCount));
+            fields.push_back("\"instances\": " + std::to_string(mesh.instanceCount));
+            fields.push_back("\"draws\": " + std::to_string(mesh.drawCount));
+            fields.push_back("\"loadMilliseconds\": { \"mesh\": " + milliseconds(mesh.meshMilliseconds) + ", \"textures\": " + milliseconds(mesh.textureMilliseconds)
+                             + ", \"upload\": " + milliseconds(mesh.uploadMilliseconds) + ", \"total\": " + milliseconds(mesh.totalMilliseconds) + " }");
+            fields.push_back("\"peakResidentBytes\": " + std::to_string(mesh.peakResidentBytes));
+            const char* statisticsNames[4] = { "frameMilliseconds", "cpuUpdateMilliseconds", "cpuDrawMilliseconds", "gpuDrawMilliseconds" };
+            const FrameStatistics* statistics[4] = { &mesh.frameTimes, &mesh.cpuUpdateTimes, &mesh.cpuDrawTimes, &mesh.gpuDrawTimes };
+            for (int s = 0; s < 4; s++)
+            {
+                if (statistics[s]->Count() == 0) { continue; }
+                fields.push_back(std::string("\"") + statisticsNames[s] + "\": { \"min\": " + milliseconds(statistics[s]->Min()) + ", \"average\": " + milliseconds(statistics[s]->Average())
+                                 + ", \"p50\": " + milliseconds(statistics[s]->Percentile(0.5)) + ", \"p90\": " + milliseconds(statistics[s]->Percentile(0.9))
+                                 + ", \"p99\": " + milliseconds(statistics[s]->Percentile(0.99)) + ", \"max\": " + milliseconds(statistics[s]->Max()) + " }");
+            }
+            if (!mesh.imageHash.empty()) { fields.push_back("\"imageHash\": \"" + escape(mesh.imageHash) + "\""); }
+
+            std::string json = "    {\n";
+            for (size_t f = 0; f < fields.size(); f++) { json += "      " + fields[f] + (f + 1 < fields.size() ? ",\n" : "\n"); }
+            return json + "    }";
+        }
+
+        static bool Write(const std::string& jsonFilePath, const std::string& benchmark, const std::string& renderer, unsigned int frameCount,
+                          const std::vector<std::string>& meshesJson, std::ostream* errorStream = nullptr)
+        {
+            std::ofstream file(jsonFilePath, std::ios::binary);
+            file << "{\n  \"benchmark\": \"" << escape(benchmark) << "\",\n  \"renderer\": \"" << escape(renderer) << "\",\n  \"frames\": " << frameCount << ",\n  \"meshes\": [";
+            for (size_t i = 0; i < meshesJson.size(); i++) { file << (i == 0 ? "\n" : ",\n") << meshesJson[i]; }
+            file << "\n  ]\n}\n";
+            if (!file)
+            {
+                if (errorStream) { *errorStream << "Could not write results to " << jsonFilePath << std::endl; }
+                return false;
+            }
+            return true;
+        }
+
+        /* The elements of the meshes array of a document written by Write, as one string to pass back to Write */
+        static bool ReadMeshesJson(const std::string& jsonFilePath, std::string& meshesJson)
+        {
+            std::ifstream file(jsonFilePath, std::ios::binary);
+            std::string json((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            size_t arrayStart = json.find("\"meshes\": [");
+            size_t arrayEnd = json.rfind(']');
+            if (arrayStart == std::string::npos || arrayEnd == std::string::npos || arrayEnd < arrayStart) { return false; }
+            size_t begin = json.find('[', arrayStart) + 1;
+            while (begin < arrayEnd && (json[begin] == '\n' || json[begin] == '\r')) { begin++; }
+            size_t end = arrayEnd;
+            while (end > begin && std::isspace(static_cast<unsigned char>(json[end - 1]))) { end--; }
+            meshesJson = json.substr(begin, end - begin);
+            return !meshesJson.empty();
+        }
+
+    private:
+        static std::string milliseconds(double value)
+        {
+            char number[32];
+            snprintf(number, sizeof(number), "%.4f", value);
+            return number;
+        }
+
+        static std::string escape(const std::string& text)
+        {
+            std::string escaped;
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\') { escaped += '\\'; escaped += c; }
+                else if (static_cast<unsigned char>(c) < 0x20) { escaped += ' '; }
+                else { escaped += c; }
+            }
+            return escaped;
+        }
+};
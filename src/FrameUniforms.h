@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstring>
+#include "cyMatrix.h"
+#include "cyVector.h"
+
+/* Uniform buffer binding point of the FrameUniforms block, set with layout(binding) in the shaders */
+constexpr unsigned int FRAME_UNIFORMS_BINDING = 0;
+
+/* Uniforms shared by every draw of a frame, in the std140 layout of the FrameUniforms block of vertShader.vert and fragShader.frag.
+   They are written to the uniform buffer once per frame instead of being set on the program one by one. */
+struct FrameUniforms
+{
+    float viewProjection[16];
+    float view[16];
+    float model[16];            // places the mesh before each instance transform
+    float modelNormal[12];      // std140 stores each column of a mat3 as a vec4
+    float lightPosition[3];     // view space
+    float lightIntensity;
+    float lightAmbientIntensity;
+    float padding[3];
+
+    void Set(const cy::Matrix4f& viewProjectionMatrix, const cy::Matrix4f& viewMatrix, const cy::Matrix4f& modelMatrix, const cy::Vec3f& lightPositionView,
+             float intensity, float ambientIntensity)
+    {
+        memcpy(viewProjection, viewProjectionMatrix.cell, sizeof(viewProjection));
+        memcpy(view, viewMatrix.cell, sizeof(view));
+        memcpy(model, modelMatrix.cell, sizeof(model));
+        cy::Matrix3f modelNormalMatrix = cy::Matrix3f(modelMatrix).GetInverse().GetTranspose();
+        memset(modelNormal, 0, sizeof(modelNormal));
+        for (int column = 0; column < 3; column++) { memcpy(&modelNormal[column*4], &modelNormalMatrix.cell[column*3], 3*sizeof(float)); }
+        memcpy(lightPosition, &lightPositionView.x, sizeof(lightPosition));
+        lightIntensity = intensity;
+        lightAmbientIntensity = ambientIntensity;
+        memset(padding, 0, sizeof(padding));
+    }
+};
+static_assert(sizeof(FrameUniforms) == 272, "FrameUniforms must match the std140 layout of the FrameUniforms block");
+
+/* Uniforms still set on the program, registered once per build with GLSLProgram::RegisterUniforms(PROGRAM_UNIFORM_NAMES)
+   and then set by index without looking up their names */
+enum ProgramUniform : int
+{
+    UNIFORM_POSITION_OFFSET,
+    UNIFORM_POSITION_SCALE,
+    UNIFORM_UV_OFFSET,
+    UNIFORM_UV_SCALE,
+    UNIFORM_OCTAHEDRAL_NORMALS,
+    UNIFORM_MAP_KD,
+    UNIFORM_MAP_KS,
+    UNIFORM_MAP_KA,
+    UNIFORM_MATERIAL_INDEX
+};
+constexpr const char* PROGRAM_UNIFORM_NAMES = "positionOffset positionScale uvOffset uvScale octahedralNormals mapKd mapKs mapKa materialIndex";
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "cyMatrix.h"
+#include "cyVector.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE2
+#endif
+
+/* The six planes of a view frustum with normals pointing inside. A point p is inside a plane when Dot(normal, p) + distance >= 0. */
+struct Frustum
+{
+    cy::Vec3f normals[6];
+    float distances[6];
+
+    /* Planes of the clip volume -w <= x, y, z <= w of an OpenGL projection, in the space the matrix transforms from */
+    static Frustum FromViewProjection(const cy::Matrix4f& viewProjection)
+    {
+        Frustum frustum;
+        cy::Vec4f rows[4];
+        for (int r = 0; r < 4; r++) { rows[r] = cy::Vec4f(viewProjection.cell[r], viewProjection.cell[r + 4], viewProjection.cell[r + 8], viewProjection.cell[r + 12]); }
+        for (int axis = 0; axis < 3; axis++)
+        {
+            frustum.setPlane(axis*2, rows[3] + rows[axis]);
+            frustum.setPlane(axis*2 + 1, rows[3] - rows[axis]);
+        }
+        return frustum;
+    }
+
+    /* False when the box is entirely outside one of the planes. Boxes just outside a corner of the frustum still pass, like with every plane test. */
+    bool IntersectsBox(const cy::Vec3f& center, const cy::Vec3f& extent) const
+    {
+        for (int p = 0; p < 6; p++)
+        {
+            // The same operations in the same order as the SIMD test, so both reach the same decision
+            float distance = normals[p].x*center.x + normals[p].y*center.y + normals[p].z*center.z + distances[p];
+            float reach = std::abs(normals[p].x)*extent.x + std::abs(normals[p].y)*extent.y + std::abs(normals[p].z)*extent.z;
+            if (!(distance + reach >= 0.0f)) { return false; }
+        }
+        return true;
+    }
+
+    private:
+        void setPlane(int p, const cy::Vec4f& plane)
+        {
+            float length = cy::Vec3f(plane.x, plane.y, plane.z).Length();
+            float scale = length > 0.0f ? 1.0f/length : 1.0f;
+            normals[p] = cy::Vec3f(plane.x, plane.y, plane.z)*scale;
+            distances[p] = plane.w*scale;
+        }
+};
+
+/* Axis aligned boxes of the culled objects, with every coordinate of the centers and half extents in its own array so four boxes load with one SIMD load each */
+class CullBounds {
+    public:
+        std::vector<float> centerX, centerY, centerZ;
+        std::vector<float> extentX, extentY, extentZ;
+
+        size_t Count() const { return centerX.size(); }
+
+        void Clear()
+        {
+            for (std::vector<float>* values : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ }) { values->clear(); }
+        }
+
+        void Reserve(size_t count)
+        {
+            for (std::vector<float>* values : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ }) { values->reserve(count); }
+        }
+
+        void Add(const cy::Vec3f& center, const cy::Vec3f& extent)
+        {
+            centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+            extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+        }
+
+        /* Add the box holding boundMin to boundMax after transform, such as a mesh bounding box placed by its model matrix */
+        void AddTransformed(const cy::Matrix4f& transform, const cy::Vec3f& boundMin, const cy::Vec3f& boundMax)
+        {
+            cy::Vec3f center = cy::Vec3f(transform * cy::Vec4f((boundMin + boundMax)/2, 1.0f));
+            cy::Vec3f extent = (boundMax - boundMin)/2;
+            cy::Vec3f transformedExtent(0, 0, 0);
+            for (int row = 0; row < 3; row++)
+            {
+                for (int column = 0; column < 3; column++) { transformedExtent[row] += std::abs(transform.cell[column*4 + row])*extent[column]; }
+            }
+            Add(center, transformedExtent);
+        }
+};
+
+/* Projected size thresholds that pick the level of detail of each visible object.
+   Objects whose bounding sphere spans fewer than screenSizes[k] pixels on screen are drawn with level k + 1, so screenSizes is in decreasing order. */
+struct LODSelection
+{
+    cy::Vec3f cameraPosition = cy::Vec3f(0, 0, 0);
+    float pixelsPerUnit = 1.0f;  // size on screen in pixels of one unit at distance one from the camera, viewport height / (2 tan(fov/2))
+    std::vector<float> screenSizes;
+
+    size_t LevelCount() const { return screenSizes.size() + 1; }
+
+    static float PixelsPerUnit(float fovRadians, int viewportHeight) { return viewportHeight / (2*std::tan(fovRadians/2)); }
+};
+
+/* Indices of the objects inside the frustum, grouped by level of detail and in increasing order within each level */
+struct CullResult
+{
+    std::vector<std::vector<uint32_t>> levels;
+
+    size_t VisibleCount() const
+    {
+        size_t count = 0;
+        for (const std::vector<uint32_t>& level : levels) { count += level.size(); }
+        return count;
+    }
+};
+
+/* Tests object bounds against a frustum four boxes at a time and picks the level of detail of the visible ones by their projected size.
+   Large object counts are split into chunks culled on a thread pool. Everything runs on the CPU, nothing here needs a GPU. */
+class FrustumCuller {
+    public:
+        static constexpr size_t MIN_CHUNK = 4096;  // objects per thread below which splitting costs more than it saves
+
+        /* numThreads of 0 uses all hardware threads. The calling thread culls one chunk itself, so the pool has one thread less. */
+        explicit FrustumCuller(unsigned int numThreads = 0)
+        {
+            _numThreads = numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+            if (_numThreads > 1) { _pool = std::make_unique<ThreadPool>(_numThreads - 1); }
+        }
+
+        unsigned int ThreadCount() const { return _numThreads; }
+
+        void Cull(const CullBounds& bounds, const Frustum& frustum, const LODSelection& lod, CullResult& result)
+        {
+            size_t count = bounds.Count();
+            size_t chunkCount = std::max<size_t>(1, std::min<size_t>(_numThreads, count / MIN_CHUNK));
+            resetLevels(result, lod.LevelCount());
+            if (chunkCount == 1)
+            {
+                cullRange(bounds, frustum, lod, 0, count, result);
+                return;
+            }
+
+            // Chunks start on a multiple of four so only the last one has a partial group of boxes
+            _chunkResults.resize(chunkCount);
+            auto chunkStart = [&](size_t chunk) { return chunk == chunkCount ? count : (count*chunk/chunkCount) & ~size_t(3); };
+            std::vector<std::future<void>> chunks;
+            for (size_t chunk = 1; chunk < chunkCount; chunk++)
+            {
+                chunks.push_back(_pool->Submit([&, chunk]()
+                {
+                    resetLevels(_chunkResults[chunk], lod.LevelCount());
+                    cullRange(bounds, frustum, lod, chunkStart(chunk), chunkStart(chunk + 1), _chunkResults[chunk]);
+                }));
+            }
+            cullRange(bounds, frustum, lod, 0, chunkStart(1), result);
+            for (std::future<void>& chunk : chunks) { chunk.get(); }
+            for (size_t chunk = 1; chunk < chunkCount; chunk++)
+            {
+                for (size_t level = 0; level < result.levels.size(); level++)
+                {
+                    const std::vector<uint32_t>& chunkLevel = _chunkResults[chunk].levels[level];
+                    result.levels[level].insert(result.levels[level].end(), chunkLevel.begin(), chunkLevel.end());
+                }
+            }
+        }
+
+        /* One box at a time on the calling thread, the reference the SIMD culling is checked against */
+        static void CullScalar(const CullBounds& bounds, const Frustum& frustum, const LODSelection& lod, CullResult& result)
+        {
+            resetLevels(result, lod.LevelCount());
+            cullScalarRange(bounds, frustum, lod, 0, bounds.Count(), result);
+        }
+
+    private:
+        unsigned int _numThreads = 1;
+        std::unique_ptr<ThreadPool> _pool;
+        std::vector<CullResult> _chunkResults;  // kept between frames so the level lists keep their capacity
+
+        static void resetLevels(CullResult& result, size_t levelCount)
+        {
+            result.levels.resize(levelCount);
+            for (std::vector<uint32_t>& level : result.levels) { level.clear(); }
+        }
+
+        /* The level picked for a box, comparing squared sizes so no square root is taken. The SIMD path computes the same products. */
+        static size_t levelOf(const CullBounds& bounds, const LODSelection& lod, size_t i)
+        {
+            float dx = bounds.centerX[i] - lod.cameraPosition.x;
+            float dy = bounds.centerY[i] - lod.cameraPosition.y;
+            float dz = bounds.centerZ[i] - lod.cameraPosition.z;
+            float distanceSquared = dx*dx + dy*dy + dz*dz;
+            float radiusSquared = bounds.extentX[i]*bounds.extentX[i] + bounds.extentY[i]*bounds.extentY[i] + bounds.extentZ[i]*bounds.extentZ[i];
+            // Projected diameter 2 r pixelsPerUnit / distance below a size s, without dividing
+            float projectedSize = radiusSquared*(4*lod.pixelsPerUnit*lod.pixelsPerUnit);
+            size_t level = 0;
+            for (float screenSize : lod.screenSizes) { level += projectedSize < (screenSize*screenSize)*distanceSquared ? 1 : 0; }
+            return level;
+        }
+
+        static void cullScalarRange(const CullBounds& bounds, const Frustum& frustum, const LODSelection& lod, size_t begin, size_t end, CullResult& result)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                cy::Vec3f center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+                cy::Vec3f extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+                if (frustum.IntersectsBox(center, extent)) { result.levels[levelOf(bounds, lod, i)].push_back(static_cast<uint32_t>(i)); }
+            }
+        }
+
+#ifdef FRUSTUM_CULLER_SSE2
+        static void cullRange(const CullBounds& bounds, const Frustum& frustum, const LODSelection& lod, size_t begin, size_t end, CullResult& result)
+        {
+            __m128 normalX[6], normalY[6], normalZ[6], absNormalX[6], absNormalY[6], absNormalZ[6], distance[6];
+            for (int p = 0; p < 6; p++)
+            {
+                normalX[p] = _mm_set1_ps(frustum.normals[p].x);
+                normalY[p] = _mm_set1_ps(frustum.normals[p].y);
+                normalZ[p] = _mm_set1_ps(frustum.normals[p].z);
+                absNormalX[p] = _mm_set1_ps(std::abs(frustum.normals[p].x));
+                absNormalY[p] = _mm_set1_ps(std::abs(frustum.normals[p].y));
+                absNormalZ[p] = _mm_set1_ps(std::abs(frustum.normals[p].z));
+                distance[p] = _mm_set1_ps(frustum.distances[p]);
+            }
+            __m128 cameraX = _mm_set1_ps(lod.cameraPosition.x);
+            __m128 cameraY = _mm_set1_ps(lod.cameraPosition.y);
+            __m128 cameraZ = _mm_set1_ps(lod.cameraPosition.z);
+            __m128 sizeScale = _mm_set1_ps(4*lod.pixelsPerUnit*lod.pixelsPerUnit);
+            __m128 zero = _mm_setzero_ps();
+
+            size_t i = begin;
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 centerX = _mm_loadu_ps(&bounds.centerX[i]);
+                __m128 centerY = _mm_loadu_ps(&bounds.centerY[i]);
+                __m128 centerZ = _mm_loadu_ps(&bounds.centerZ[i]);
+                __m128 extentX = _mm_loadu_ps(&bounds.extentX[i]);
+                __m128 extentY = _mm_loadu_ps(&bounds.extentY[i]);
+                __m128 extentZ = _mm_loadu_ps(&bounds.extentZ[i]);
+                int inside = 0xF;
+                for (int p = 0; p < 6 && inside; p++)
+                {
+                    __m128 planeDistance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX[p], centerX), _mm_mul_ps(normalY[p], centerY)), _mm_mul_ps(normalZ[p], centerZ)), distance[p]);
+                    __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absNormalX[p], extentX), _mm_mul_ps(absNormalY[p], extentY)), _mm_mul_ps(absNormalZ[p], extentZ));
+                    inside &= _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(planeDistance, reach), zero));
+                }
+                if (!inside) { continue; }
+
+                __m128 dx = _mm_sub_ps(centerX, cameraX);
+                __m128 dy = _mm_sub_ps(centerY, cameraY);
+                __m128 dz = _mm_sub_ps(centerZ, cameraZ);
+                __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                __m128 radiusSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, extentX), _mm_mul_ps(extentY, extentY)), _mm_mul_ps(extentZ, extentZ));
+                __m128 projectedSize = _mm_mul_ps(radiusSquared, sizeScale);
+                // Every threshold the box is below adds one level, a true compare lane is -1 so it is subtracted
+                __m128i level = _mm_setzero_si128();
+                for (float screenSize : lod.screenSizes)
+                {
+                    __m128 threshold = _mm_mul_ps(_mm_set1_ps(screenSize*screenSize), distanceSquared);
+                    level = _mm_sub_epi32(level, _mm_castps_si128(_mm_cmplt_ps(projectedSize, threshold)));
+                }
+                alignas(16) int32_t levels[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(levels), level);
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if (inside & (1 << lane)) { result.levels[levels[lane]].push_back(static_cast<uint32_t>(i + lane)); }
+                }
+            }
+            cullScalarRange(bounds, frustum, lod, i, end, result);
+        }
+#else
+        static void cullRange(const CullBounds& bounds, const Frustum& frustum, const LODSelection& lod, size_t begin, size_t end, CullResult& result)
+        {
+            cullScalarRange(bounds, frustum, lod, begin, end, result);
+        }
+#endif
+};
@@ -0,0 +1,487 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include "cyTriMesh.h"
+#include "cyVector.h"
+#include "MeshData.h"
+#include "ThreadPool.h"
+
+/* Flattened BVH node. The two children of an interior node are stored next to each other, starting at an even index of
+   64 byte aligned storage, so one 64 byte cache line holds both. */
+struct BVHNode
+{
+    cy::Vec3f boundMin;
+    uint32_t leftFirst;      // index of the left child for interior nodes, index of the first triangle for leaves
+    cy::Vec3f boundMax;
+    uint32_t triangleCount;  // 0 for interior nodes
+};
+static_assert(sizeof(BVHNode) == 32, "a sibling pair of nodes has to fill one 64 byte cache line");
+
+/* Allocator for std::vector storage starting on an ALIGNMENT byte boundary */
+template <typename T, size_t ALIGNMENT>
+struct AlignedAllocator
+{
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAllocator<U, ALIGNMENT>; };
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) { }
+
+    T* allocate(size_t count) { return static_cast<T*>(::operator new(count*sizeof(T), std::align_val_t(ALIGNMENT))); }
+    void deallocate(T* pointer, size_t) { ::operator delete(pointer, std::align_val_t(ALIGNMENT)); }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, ALIGNMENT>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U, ALIGNMENT>&) const { return false; }
+};
+
+using BVHNodeArray = std::vector<BVHNode, AlignedAllocator<BVHNode, 64>>;
+
+/* Closest hit along a ray, with the barycentric coordinates of the hit inside the face */
+struct RayHit
+{
+    float t = std::numeric_limits<float>::max();
+    float u = 0.0f;
+    float v = 0.0f;
+    uint32_t face = 0;
+};
+
+/* Bounding volume hierarchy over the triangles of a mesh, built with binned SAH and answering closest-hit and any-hit ray queries */
+class MeshBVH {
+    public:
+        static constexpr unsigned int BIN_COUNT = 16;
+        static constexpr unsigned int MAX_LEAF_TRIANGLES = 8;
+        static constexpr unsigned int MAX_DEPTH = 64;
+        static constexpr float TRAVERSAL_COST = 1.0f;  // cost of visiting a node relative to one ray triangle test
+
+        /* Build over triangleCount triangles. corner(face, i) returns corner i of a face.
+           numThreads of 0 uses all hardware threads. The calling thread builds too, so the pool kept for later builds has one thread less. */
+        template <typename CornerFunc>
+        bool Build(size_t triangleCount, CornerFunc corner, unsigned int numThreads = 0)
+        {
+            _nodes.clear();
+            _triangles.clear();
+            _faces.clear();
+            if (triangleCount == 0 || triangleCount >= 0x7FFFFFFFu) { return false; }
+            if (numThreads == 0) { numThreads = std::max(1u, std::thread::hardware_concurrency()); }
+            if (numThreads == 1) { _pool.reset(); }
+            else if (!_pool || _pool->ThreadCount() != numThreads - 1) { _pool = std::make_unique<ThreadPool>(numThreads - 1); }
+
+            BuildContext context;
+            context.triangles.resize(triangleCount);
+            parallelFor(triangleCount, numThreads, [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t face = begin; face < end; face++)
+                {
+                    cy::Vec3f a = corner(face, 0);
+                    cy::Vec3f b = corner(face, 1);
+                    cy::Vec3f c = corner(face, 2);
+                    BuildTriangle& triangle = context.triangles[face];
+                    triangle.boundMin = cy::Vec3f(std::min({ a.x, b.x, c.x }), std::min({ a.y, b.y, c.y }), std::min({ a.z, b.z, c.z }));
+                    triangle.boundMax = cy::Vec3f(std::max({ a.x, b.x, c.x }), std::max({ a.y, b.y, c.y }), std::max({ a.z, b.z, c.z }));
+                    triangle.centroid = (a + b + c) / 3.0f;
+                    triangle.face = static_cast<uint32_t>(face);
+                }
+            });
+
+            // A binary tree over N leaves has at most 2N - 1 nodes. Node 1 stays unused so sibling pairs start at even indices.
+            _nodes.resize(triangleCount*2 + 1);
+            context.nodesUsed = 2;
+            context.numThreads = numThreads;
+            context.spareThreads = static_cast<int>(numThreads) - 1;
+            subdivide(context, 0, 0, static_cast<uint32_t>(triangleCount), 0);
+            _nodes.resize(context.nodesUsed);
+            _nodes.shrink_to_fit();
+
+            // Store the triangles in leaf order, ready for the intersection test
+            _triangles.resize(triangleCount);
+            _faces.resize(triangleCount);
+            parallelFor(triangleCount, numThreads, [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    uint32_t face = context.triangles[i].face;
+                    cy::Vec3f vertex0 = corner(face, 0);
+                    _triangles[i].vertex0 = vertex0;
+                    _triangles[i].edge1 = corner(face, 1) - vertex0;
+                    _triangles[i].edge2 = corner(face, 2) - vertex0;
+                    _faces[i] = face;
+                }
+            });
+            return true;
+        }
+
+        /* Faces are the triangles of the index buffer, so face f covers indices [3f, 3f+3) */
+        bool BuildFromMeshData(const MeshData& meshData, unsigned int numThreads = 0)
+        {
+            std::vector<uint32_t> indices32 = meshData.GetIndices32();
+            return Build(meshData.indexCount / 3, [&](size_t face, int corner) { return meshData.vertices[indices32[face*3 + corner]].position; }, numThreads);
+        }
+
+        bool BuildFromTriMesh(const cy::TriMesh& mesh, unsigned int numThreads = 0)
+        {
+            return Build(mesh.NF(), [&](size_t face, int corner) { return mesh.V(mesh.F(static_cast<int>(face)).v[corner]); }, numThreads);
+        }
+
+        /* Find the nearest triangle hit with 0 < t < tMax. direction does not need to be normalized, t is measured in its length. */
+        bool IntersectClosest(const cy::Vec3f& origin, const cy::Vec3f& direction, RayHit& hit, float tMax = std::numeric_limits<float>::max()) const
+        {
+            hit.t = tMax;
+            return traverse<false>(origin, direction, hit);
+        }
+
+        /* Report whether any triangle is hit with 0 < t < tMax, for shadow and visibility rays */
+        bool IntersectAny(const cy::Vec3f& origin, const cy::Vec3f& direction, float tMax = std::numeric_limits<float>::max()) const
+        {
+            RayHit hit;
+            hit.t = tMax;
+            return traverse<true>(origin, direction, hit);
+        }
+
+        size_t NodeCount() const { return _nodes.size(); }
+        size_t TriangleCount() const { return _triangles.size(); }
+        const BVHNodeArray& Nodes() const { return _nodes; }
+
+        void PrintStats(std::ostream& outStream) const
+        {
+            size_t leafCount = 0;
+            for (const BVHNode& node : _nodes) { leafCount += node.triangleCount > 0 ? 1 : 0; }
+            double trianglesPerLeaf = leafCount > 0 ? static_cast<double>(_triangles.size()) / leafCount : 0.0;
+            outStream << "BVH: " << _triangles.size() << " triangles, " << _nodes.size() << " nodes, " << leafCount << " leaves, "
+                      << trianglesPerLeaf << " triangles per leaf, " << _nodes.size()*sizeof(BVHNode) + _triangles.size()*(sizeof(LeafTriangle) + sizeof(uint32_t)) << " bytes" << std::endl;
+        }
+
+    private:
+        /* Triangles are partitioned in place while building, so every pass over a node reads memory in order */
+        struct BuildTriangle
+        {
+            cy::Vec3f boundMin;
+            cy::Vec3f boundMax;
+            cy::Vec3f centroid;
+            uint32_t face;
+        };
+
+        /* Triangle in the form the Moller-Trumbore test needs */
+        struct LeafTriangle
+        {
+            cy::Vec3f vertex0;
+            cy::Vec3f edge1;
+            cy::Vec3f edge2;
+        };
+
+        struct Bounds
+        {
+            cy::Vec3f boundMin = cy::Vec3f(std::numeric_limits<float>::max());
+            cy::Vec3f boundMax = cy::Vec3f(-std::numeric_limits<float>::max());
+
+            void Grow(const cy::Vec3f& pointMin, const cy::Vec3f& pointMax)
+            {
+                boundMin = cy::Vec3f(std::min(boundMin.x, pointMin.x), std::min(boundMin.y, pointMin.y), std::min(boundMin.z, pointMin.z));
+                boundMax = cy::Vec3f(std::max(boundMax.x, pointMax.x), std::max(boundMax.y, pointMax.y), std::max(boundMax.z, pointMax.z));
+            }
+            void Grow(const cy::Vec3f& point) { Grow(point, point); }
+            void Grow(const Bounds& other) { Grow(other.boundMin, other.boundMax); }
+            float HalfArea() const
+            {
+                if (boundMin.x > boundMax.x) { return 0.0f; }
+                cy::Vec3f extent = boundMax - boundMin;
+                return extent.x*extent.y + extent.y*extent.z + extent.z*extent.x;
+            }
+        };
+
+        struct Bin
+        {
+            Bounds bounds;
+            uint32_t count = 0;
+        };
+
+        struct BuildContext
+        {
+            std::vector<BuildTriangle> triangles;
+            std::atomic<uint32_t> nodesUsed{ 0 };
+            std::atomic<int> spareThreads{ 0 };
+            unsigned int numThreads = 1;
+        };
+
+        // Nodes above this size are binned and split on several threads
+        static constexpr uint32_t PARALLEL_TRIANGLES = 1 << 16;
+
+        BVHNodeArray _nodes;
+        std::vector<LeafTriangle> _triangles;
+        std::vector<uint32_t> _faces;
+        std::unique_ptr<ThreadPool> _pool;  // shared by every parallel pass and subtree of a build, and kept for the next build
+
+        /* Runs func(begin, end, chunk) on up to numThreads chunks of at least 4096 items */
+        template <typename FUNC>
+        void parallelFor(size_t count, unsigned int numThreads, FUNC func)
+        {
+            size_t chunkCount = std::min<size_t>(numThreads, (count + 4095) / 4096);
+            if (chunkCount <= 1 || !_pool) { func(size_t(0), count, 0u); return; }
+            _pool->ParallelFor(chunkCount, [&](size_t chunk) { func(count*chunk/chunkCount, count*(chunk + 1)/chunkCount, static_cast<unsigned int>(chunk)); });
+        }
+
+        void subdivide(BuildContext& context, uint32_t nodeIndex, uint32_t first, uint32_t count, unsigned int depth)
+        {
+            // Nodes near the root are binned with the threads that are not yet busy with subtrees
+            unsigned int binThreads = count >= PARALLEL_TRIANGLES ? std::max(1u, context.numThreads >> std::min(depth, 31u)) : 1;
+            // Per chunk scratch lives on the stack unless several threads bin this node
+            Bounds localBounds[2];
+            Bin localBins[3*BIN_COUNT];
+            std::vector<Bounds> sharedBounds(binThreads > 1 ? binThreads*2 : 0);
+            std::vector<Bin> sharedBins(binThreads > 1 ? binThreads*3*BIN_COUNT : 0);
+            Bounds* chunkBounds = binThreads > 1 ? sharedBounds.data() : localBounds;
+            Bin* chunkBins = binThreads > 1 ? sharedBins.data() : localBins;
+
+            // Triangle bounds and centroid bounds of each chunk
+            Bounds bounds;
+            Bounds centroidBounds;
+            parallelFor(count, binThreads, [&](size_t begin, size_t end, unsigned int chunk)
+            {
+                for (size_t i = first + begin; i < first + end; i++)
+                {
+                    const BuildTriangle& triangle = context.triangles[i];
+                    chunkBounds[chunk*2].Grow(triangle.boundMin, triangle.boundMax);
+                    chunkBounds[chunk*2 + 1].Grow(triangle.centroid);
+                }
+            });
+            for (unsigned int chunk = 0; chunk < binThreads; chunk++)
+            {
+                bounds.Grow(chunkBounds[chunk*2]);
+                centroidBounds.Grow(chunkBounds[chunk*2 + 1]);
+            }
+            BVHNode& node = _nodes[nodeIndex];
+            node.boundMin = bounds.boundMin;
+            node.boundMax = bounds.boundMax;
+            node.leftFirst = first;
+            node.triangleCount = count;
+            if (count <= 1 || depth + 1 >= MAX_DEPTH) { return; }
+
+            // Evaluate BIN_COUNT - 1 split planes per axis over the centroid bounds
+            int bestAxis = -1;
+            uint32_t bestSplit = 0;
+            float bestCost = std::numeric_limits<float>::max();
+            cy::Vec3f centroidExtent = centroidBounds.boundMax - centroidBounds.boundMin;
+            cy::Vec3f binScale;
+            for (int axis = 0; axis < 3; axis++) { binScale[axis] = centroidExtent[axis] > 0.0f ? BIN_COUNT / centroidExtent[axis] : 0.0f; }
+
+            // Every chunk of triangles fills its own bins for all three axes in one pass
+            parallelFor(count, binThreads, [&](size_t begin, size_t end, unsigned int chunk)
+            {
+                Bin* bins = &chunkBins[static_cast<size_t>(chunk)*3*BIN_COUNT];
+                for (size_t i = first + begin; i < first + end; i++)
+                {
+                    const BuildTriangle& triangle = context.triangles[i];
+                    for (int axis = 0; axis < 3; axis++)
+                    {
+                        Bin& bin = bins[axis*BIN_COUNT + binOf(triangle.centroid[axis], centroidBounds.boundMin[axis], binScale[axis])];
+                        bin.count++;
+                        bin.bounds.Grow(triangle.boundMin, triangle.boundMax);
+                    }
+                }
+            });
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                if (!(centroidExtent[axis] > 0.0f)) { continue; }
+                Bin bins[BIN_COUNT];
+                for (unsigned int chunk = 0; chunk < binThreads; chunk++)
+                {
+                    for (unsigned int b = 0; b < BIN_COUNT; b++)
+                    {
+                        const Bin& chunkBin = chunkBins[(chunk*3 + axis)*BIN_COUNT + b];
+                        bins[b].count += chunkBin.count;
+                        bins[b].bounds.Grow(chunkBin.bounds);
+                    }
+                }
+
+                float leftCost[BIN_COUNT - 1];
+                Bounds leftBounds;
+                uint32_t leftCount = 0;
+                for (unsigned int b = 0; b < BIN_COUNT - 1; b++)
+                {
+                    leftCount += bins[b].count;
+                    leftBounds.Grow(bins[b].bounds);
+                    leftCost[b] = leftCount * leftBounds.HalfArea();
+                }
+                Bounds rightBounds;
+                uint32_t rightCount = 0;
+                for (unsigned int b = BIN_COUNT - 1; b > 0; b--)
+                {
+                    rightCount += bins[b].count;
+                    rightBounds.Grow(bins[b].bounds);
+                    float cost = leftCost[b - 1] + rightCount * rightBounds.HalfArea();
+                    if (rightCount > 0 && rightCount < count && cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = b;
+                    }
+                }
+            }
+
+            // Keep the node as a leaf if no split beats intersecting all of its triangles
+            BuildTriangle* triangles = context.triangles.data() + first;
+            uint32_t leftCount = 0;
+            float leafCost = count * bounds.HalfArea();
+            if (bestAxis >= 0 && (TRAVERSAL_COST*bounds.HalfArea() + bestCost < leafCost || count > MAX_LEAF_TRIANGLES))
+            {
+                BuildTriangle* middle = std::partition(triangles, triangles + count, [&](const BuildTriangle& triangle)
+                {
+                    return binOf(triangle.centroid[bestAxis], centroidBounds.boundMin[bestAxis], binScale[bestAxis]) < bestSplit;
+                });
+                leftCount = static_cast<uint32_t>(middle - triangles);
+            }
+            else if (count > MAX_LEAF_TRIANGLES)
+            {
+                // All centroids coincide, split the list in half
+                leftCount = count / 2;
+            }
+            if (leftCount == 0 || leftCount == count) { return; }
+
+            uint32_t leftChild = context.nodesUsed.fetch_add(2);
+            node.leftFirst = leftChild;
+            node.triangleCount = 0;
+
+            bool buildInParallel = count >= PARALLEL_TRIANGLES && context.spareThreads.fetch_sub(1) > 0;
+            if (buildInParallel)
+            {
+                _pool->ParallelFor(2, [&](size_t child)
+                {
+                    if (child == 0) { subdivide(context, leftChild, first, leftCount, depth + 1); }
+                    else { subdivide(context, leftChild + 1, first + leftCount, count - leftCount, depth + 1); }
+                });
+            }
+            else
+            {
+                subdivide(context, leftChild, first, leftCount, depth + 1);
+                subdivide(context, leftChild + 1, first + leftCount, count - leftCount, depth + 1);
+            }
+            if (count >= PARALLEL_TRIANGLES) { context.spareThreads++; }
+        }
+
+        static uint32_t binOf(float centroid, float binMin, float binScale)
+        {
+            int bin = static_cast<int>((centroid - binMin) * binScale);
+            return static_cast<uint32_t>(std::clamp(bin, 0, static_cast<int>(BIN_COUNT) - 1));
+        }
+
+        /* Distance to where the ray enters the box, or the float maximum if it misses it before tMax.
+           A ray parallel to a slab whose origin lies on one of its planes computes 0 * infinity = NaN there. std::max(a, b) and std::min(a, b)
+           return a when b is NaN, so with the running bound as the first argument such a slab leaves the interval unchanged and the ray
+           counts as inside it. Swapping the arguments would carry the NaN into the interval and miss the box. */
+        static float intersectBox(const BVHNode& node, const cy::Vec3f& origin, const cy::Vec3f& inverseDirection, float tMax)
+        {
+            float tEnter = std::numeric_limits<float>::lowest();
+            float tExit = std::numeric_limits<float>::max();
+            // Kept in separate variables so the compiler emits branchless min and max instructions instead of compares and jumps
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float t1 = (node.boundMin[axis] - origin[axis]) * inverseDirection[axis];
+                float t2 = (node.boundMax[axis] - origin[axis]) * inverseDirection[axis];
+                float enter1 = std::max(tEnter, t1);
+                float enter2 = std::max(tEnter, t2);
+                float exit1 = std::min(tExit, t1);
+                float exit2 = std::min(tExit, t2);
+                tEnter = std::min(enter1, enter2);
+                tExit = std::max(exit1, exit2);
+            }
+            if (tExit >= tEnter && tEnter < tMax && tExit > 0.0f) { return tEnter; }
+            return std::numeric_limits<float>::max();
+        }
+
+        /* Moller-Trumbore ray triangle test, updates hit if the triangle is closer */
+        static bool intersectTriangle(const LeafTriangle& triangle, const cy::Vec3f& origin, const cy::Vec3f& direction, RayHit& hit)
+        {
+            cy::Vec3f h = direction.Cross(triangle.edge2);
+            float determinant = triangle.edge1.Dot(h);
+            if (determinant == 0.0f) { return false; }
+            float inverseDeterminant = 1.0f / determinant;
+            cy::Vec3f s = origin - triangle.vertex0;
+            float u = inverseDeterminant * s.Dot(h);
+            if (u < 0.0f || u > 1.0f) { return false; }
+            cy::Vec3f q = s.Cross(triangle.edge1);
+            float v = inverseDeterminant * direction.Dot(q);
+            if (v < 0.0f || u + v > 1.0f) { return false; }
+            float t = inverseDeterminant * triangle.edge2.Dot(q);
+            if (t <= 0.0f || t >= hit.t) { return false; }
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+            return true;
+        }
+
+        /* Visit the nearer child first and skip stacked nodes that are farther than the closest hit found since they were pushed */
+        template <bool anyHit>
+        bool traverse(const cy::Vec3f& origin, const cy::Vec3f& direction, RayHit& hit) const
+        {
+            if (_nodes.empty()) { return false; }
+            cy::Vec3f inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+            const float miss = std::numeric_limits<float>::max();
+            if (intersectBox(_nodes[0], origin, inverseDirection, hit.t) == miss) { return false; }
+
+            uint32_t stackNodes[MAX_DEPTH];
+            float stackDistances[MAX_DEPTH];
+            int stackSize = 0;
+            uint32_t nodeIndex = 0;
+            bool found = false;
+            while (true)
+            {
+                const BVHNode& node = _nodes[nodeIndex];
+                if (node.triangleCount > 0)
+                {
+                    for (uint32_t i = node.leftFirst; i < node.leftFirst + node.triangleCount; i++)
+                    {
+                        if (intersectTriangle(_triangles[i], origin, direction, hit))
+                        {
+                            hit.face = _faces[i];
+                            found = true;
+                            if (anyHit) { return true; }
+                        }
+                    }
+                }
+                else
+                {
+                    uint32_t nearChild = node.leftFirst;
+                    uint32_t farChild = nearChild + 1;
+                    float nearDistance = intersectBox(_nodes[nearChild], origin, inverseDirection, hit.t);
+                    float farDistance = intersectBox(_nodes[farChild], origin, inverseDirection, hit.t);
+                    if (farDistance < nearDistance)
+                    {
+                        std::swap(nearChild, farChild);
+                        std::swap(nearDistance, farDistance);
+                    }
+                    if (nearDistance != miss)
+                    {
+                        if (farDistance != miss)
+                        {
+                            stackNodes[stackSize] = farChild;
+                            stackDistances[stackSize] = farDistance;
+                            stackSize++;
+                        }
+                        nodeIndex = nearChild;
+                        continue;
+                    }
+                }
+
+                // Pop the next node that can still hold a closer hit
+                bool popped = false;
+                while (stackSize > 0 && !popped)
+                {
+                    stackSize--;
+                    if (stackDistances[stackSize] < hit.t)
+                    {
+                        nodeIndex = stackNodes[stackSize];
+                        popped = true;
+                    }
+                }
+                if (!popped) { return found; }
+            }
+        }
+};
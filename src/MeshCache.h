@@ -0,0 +1,316 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <cctype>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "MeshData.h"
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/* Read only memory mapping of a whole file */
+class MappedFile {
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() { Close(); }
+
+        bool Open(const std::filesystem::path& path)
+        {
+            Close();
+#ifdef _WIN32
+            _fileHandle = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (_fileHandle == INVALID_HANDLE_VALUE) { _fileHandle = NULL; return false; }
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(_fileHandle, &fileSize)) { Close(); return false; }
+            _size = static_cast<size_t>(fileSize.QuadPart);
+            if (_size == 0) { return true; }
+            _mappingHandle = CreateFileMappingW(_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (!_mappingHandle) { Close(); return false; }
+            _data = static_cast<const unsigned char*>(MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+            if (!_data) { Close(); return false; }
+#else
+            int fileDescriptor = open(path.c_str(), O_RDONLY);
+            if (fileDescriptor < 0) { return false; }
+            struct stat fileStatus;
+            if (fstat(fileDescriptor, &fileStatus) != 0) { close(fileDescriptor); return false; }
+            _size = static_cast<size_t>(fileStatus.st_size);
+            if (_size > 0)
+            {
+                void* mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+                if (mapping == MAP_FAILED) { close(fileDescriptor); _size = 0; return false; }
+                _data = static_cast<const unsigned char*>(mapping);
+            }
+            close(fileDescriptor);
+#endif
+            return true;
+        }
+
+        void Close()
+        {
+#ifdef _WIN32
+            if (_data) { UnmapViewOfFile(_data); }
+            if (_mappingHandle) { CloseHandle(_mappingHandle); }
+            if (_fileHandle) { CloseHandle(_fileHandle); }
+            _mappingHandle = NULL;
+            _fileHandle = NULL;
+#else
+            if (_data) { munmap(const_cast<unsigned char*>(_data), _size); }
+#endif
+            _data = nullptr;
+            _size = 0;
+        }
+
+        const unsigned char* Data() const { return _data; }
+        size_t Size() const { return _size; }
+
+    private:
+        const unsigned char* _data = nullptr;
+        size_t _size = 0;
+#ifdef _WIN32
+        HANDLE _fileHandle = NULL;
+        HANDLE _mappingHandle = NULL;
+#endif
+};
+
+/* Identifies the exact obj file, the mtllib files it names, and MeshBuildOptions a cache was built from */
+struct MeshCacheKey
+{
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint64_t materialHash;  // name, size, modification time, and contents of every mtllib file, the materials and texture names are cached from them
+    uint64_t buildOptions;
+
+    bool operator==(const MeshCacheKey& other) const
+    {
+        return sourceSize == other.sourceSize && sourceTime == other.sourceTime && sourceHash == other.sourceHash && materialHash == other.materialHash
+            && buildOptions == other.buildOptions;
+    }
+};
+
+/* Versioned binary file with the final interleaved vertex stream, index stream, materials, and bounding box of a mesh.
+   Loading memory maps the file so the vertex and index data can be handed to glBufferData without parsing or copying. */
+class MeshCache {
+    public:
+        static constexpr uint32_t VERSION = 4;
+
+        /* The cache is written next to the obj file */
+        static std::filesystem::path PathFor(const std::filesystem::path& objFilePath)
+        {
+            std::filesystem::path cachePath = objFilePath;
+            return cachePath.replace_extension(".meshcache");
+        }
+
+        static bool ComputeKey(const std::filesystem::path& objFilePath, uint64_t buildOptions, MeshCacheKey& key)
+        {
+            std::error_code error;
+            auto writeTime = std::filesystem::last_write_time(objFilePath, error);
+            if (error) { return false; }
+            MappedFile objFile;
+            if (!objFile.Open(objFilePath)) { return false; }
+            key.sourceSize = objFile.Size();
+            key.sourceTime = static_cast<int64_t>(writeTime.time_since_epoch().count());
+            key.sourceHash = HashBytes(objFile.Data(), objFile.Size());
+            key.materialHash = hashMaterialLibraries(objFilePath, objFile.Data(), objFile.Size());
+            key.buildOptions = buildOptions;
+            return true;
+        }
+
+        /* File names of the mtllib lines of an obj file in order, with the white space around them removed */
+        static std::vector<std::string> MaterialLibraryNames(const unsigned char* data, size_t size)
+        {
+            std::vector<std::string> names;
+            const char* text = reinterpret_cast<const char*>(data);
+            const char* end = text + size;
+            for (const char* line = text; line < end; )
+            {
+                const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+                if (!lineEnd) { lineEnd = end; }
+                const char* c = line;
+                while (c < lineEnd && (*c == ' ' || *c == '\t')) { c++; }
+                if (lineEnd - c > 6 && memcmp(c, "mtllib", 6) == 0 && (c[6] == ' ' || c[6] == '\t'))
+                {
+                    const char* nameBegin = c + 6;
+                    const char* nameEnd = lineEnd;
+                    while (nameBegin < nameEnd && isspace(static_cast<unsigned char>(*nameBegin))) { nameBegin++; }
+                    while (nameEnd > nameBegin && isspace(static_cast<unsigned char>(nameEnd[-1]))) { nameEnd--; }
+                    if (nameEnd > nameBegin) { names.emplace_back(nameBegin, nameEnd); }
+                }
+                line = lineEnd + 1;
+            }
+            return names;
+        }
+
+        /* 64-bit hash of the file contents, eight bytes at a time */
+        static uint64_t HashBytes(const unsigned char* data, size_t size)
+        {
+            const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+            uint64_t hash = 0xCBF29CE484222325ull ^ (size * multiplier);
+            size_t wordCount = size / 8;
+            for (size_t i = 0; i < wordCount; i++)
+            {
+                uint64_t word;
+                memcpy(&word, data + i*8, 8);
+                hash = (hash ^ (word * 0xFF51AFD7ED558CCDull)) * multiplier;
+                hash ^= hash >> 29;
+            }
+            uint64_t tail = 0;
+            if (size > wordCount*8) { memcpy(&tail, data + wordCount*8, size - wordCount*8); }
+            hash = (hash ^ (tail * 0xFF51AFD7ED558CCDull)) * multiplier;
+            return hash ^ (hash >> 32);
+        }
+
+        /* Write the cache to a temporary file first so an interrupted write never leaves a broken cache behind */
+        static bool Save(const std::filesystem::path& cachePath, const MeshCacheKey& key, const MeshData& meshData)
+        {
+            Header header = {};
+            memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.headerSize = sizeof(Header);
+            header.vertexStride = sizeof(MeshVertex);
+            header.materialStride = sizeof(MeshMaterial);
+            header.key = key;
+            header.vertexCount = meshData.vertexCount;
+            header.indexCount = meshData.indexCount;
+            header.indexSize = meshData.indexSize;
+            header.materialCount = meshData.materialCount;
+            header.materialOffset = alignUp(sizeof(Header));
+            header.vertexOffset = alignUp(header.materialOffset + header.materialCount*sizeof(MeshMaterial));
+            header.indexOffset = alignUp(header.vertexOffset + header.vertexCount*sizeof(MeshVertex));
+            for (int i = 0; i < 3; i++)
+            {
+                header.boundMin[i] = meshData.boundMin[i];
+                header.boundMax[i] = meshData.boundMax[i];
+            }
+
+            std::filesystem::path temporaryPath = cachePath;
+            temporaryPath += ".tmp";
+            FILE* fp = fopen(temporaryPath.string().c_str(), "wb");
+            if (!fp) { return false; }
+            bool written = fwrite(&header, sizeof(Header), 1, fp) == 1
+                && writePadding(fp, header.materialOffset - sizeof(Header))
+                && fwrite(meshData.materials, sizeof(MeshMaterial), meshData.materialCount, fp) == meshData.materialCount
+                && writePadding(fp, header.vertexOffset - header.materialOffset - header.materialCount*sizeof(MeshMaterial))
+                && fwrite(meshData.vertices, sizeof(MeshVertex), meshData.vertexCount, fp) == meshData.vertexCount
+                && writePadding(fp, header.indexOffset - header.vertexOffset - header.vertexCount*sizeof(MeshVertex))
+                && fwrite(meshData.indices, meshData.indexSize, meshData.indexCount, fp) == meshData.indexCount;
+            written = (fclose(fp) == 0) && written;
+
+            std::error_code error;
+            if (written) { std::filesystem::rename(temporaryPath, cachePath, error); }
+            if (!written || error)
+            {
+                std::filesystem::remove(temporaryPath, error);
+                return false;
+            }
+            return true;
+        }
+
+        /* Map the cache and point meshData into it. Fails if the cache is missing, corrupt, or was built from a different obj file.
+           The mapping stays valid while this MeshCache is alive. */
+        bool Load(const std::filesystem::path& cachePath, const MeshCacheKey& key, MeshData& meshData)
+        {
+            if (!_file.Open(cachePath)) { return false; }
+            if (_file.Size() < sizeof(Header)) { _file.Close(); return false; }
+            Header header;
+            memcpy(&header, _file.Data(), sizeof(Header));
+            bool valid = memcmp(header.magic, MAGIC, sizeof(header.magic)) == 0
+                && header.version == VERSION
+                && header.headerSize == sizeof(Header)
+                && header.vertexStride == sizeof(MeshVertex)
+                && header.materialStride == sizeof(MeshMaterial)
+                && header.key == key
+                && (header.indexSize == 2 || header.indexSize == 4)
+                && header.materialOffset % ALIGNMENT == 0 && header.vertexOffset % ALIGNMENT == 0 && header.indexOffset % ALIGNMENT == 0
+                && header.materialOffset + header.materialCount*sizeof(MeshMaterial) <= _file.Size()
+                && header.vertexOffset + header.vertexCount*sizeof(MeshVertex) <= _file.Size()
+                && header.indexOffset + header.indexCount*header.indexSize <= _file.Size();
+            if (!valid) { _file.Close(); return false; }
+
+            meshData.SetExternal(
+                reinterpret_cast<const MeshVertex*>(_file.Data() + header.vertexOffset), static_cast<size_t>(header.vertexCount),
+                _file.Data() + header.indexOffset, static_cast<size_t>(header.indexCount), header.indexSize,
+                reinterpret_cast<const MeshMaterial*>(_file.Data() + header.materialOffset), static_cast<size_t>(header.materialCount));
+            meshData.boundMin.Set(header.boundMin[0], header.boundMin[1], header.boundMin[2]);
+            meshData.boundMax.Set(header.boundMax[0], header.boundMax[1], header.boundMax[2]);
+            return true;
+        }
+
+    private:
+        static constexpr char MAGIC[8] = { 'I', 'G', 'P', 'M', 'E', 'S', 'H', '\0' };
+        static constexpr uint64_t ALIGNMENT = 64;
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t headerSize;
+            uint32_t vertexStride;
+            uint32_t materialStride;
+            MeshCacheKey key;
+            uint64_t vertexCount;
+            uint64_t vertexOffset;
+            uint64_t indexCount;
+            uint64_t indexOffset;
+            uint32_t indexSize;
+            uint32_t reserved;
+            uint64_t materialCount;
+            uint64_t materialOffset;
+            float boundMin[3];
+            float boundMax[3];
+        };
+
+        MappedFile _file;
+
+        /* Editing a .mtl file changes the cached materials without touching the obj file. A library that is missing is hashed too,
+           so creating it later also invalidates the cache. Libraries are resolved relative to the obj file like the mesh loader does. */
+        static uint64_t hashMaterialLibraries(const std::filesystem::path& objFilePath, const unsigned char* objData, size_t objSize)
+        {
+            uint64_t hash = 0;
+            auto combine = [&](uint64_t value) { hash = HashBytes(reinterpret_cast<const unsigned char*>(&value), sizeof(value)) ^ (hash * 0x9E3779B97F4A7C15ull); };
+            for (const std::string& name : MaterialLibraryNames(objData, objSize))
+            {
+                combine(HashBytes(reinterpret_cast<const unsigned char*>(name.data()), name.size()));
+                std::filesystem::path mtlFilePath = objFilePath.parent_path() / name;
+                std::error_code error;
+                auto writeTime = std::filesystem::last_write_time(mtlFilePath, error);
+                MappedFile mtlFile;
+                if (error || !mtlFile.Open(mtlFilePath))
+                {
+                    combine(~0ull);
+                    continue;
+                }
+                combine(mtlFile.Size());
+                combine(static_cast<uint64_t>(writeTime.time_since_epoch().count()));
+                combine(HashBytes(mtlFile.Data(), mtlFile.Size()));
+            }
+            return hash;
+        }
+
+        static uint64_t alignUp(uint64_t offset) { return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT; }
+
+        static bool writePadding(FILE* fp, uint64_t byteCount)
+        {
+            const char zeros[ALIGNMENT] = {};
+            return byteCount == 0 || fwrite(zeros, 1, static_cast<size_t>(byteCount), fp) == byteCount;
+        }
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "cyTriMesh.h"
+#include "cyVector.h"
+#include "MeshOptimizer.h"
+
+/* Interleaved vertex layout uploaded to the GPU */
+struct MeshVertex
+{
+    cy::Vec3f position;
+    cy::Vec3f normal;
+    cy::Vec2f uv;
+};
+
+/* Material constants, texture file names, and the range of indices drawn with the material */
+struct MeshMaterial
+{
+    static constexpr size_t NAME_LENGTH = 256;
+
+    float Ka[3];
+    float Kd[3];
+    float Ks[3];
+    float Ns;
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    char name[NAME_LENGTH];
+    char mapKa[NAME_LENGTH];
+    char mapKd[NAME_LENGTH];
+    char mapKs[NAME_LENGTH];
+};
+
+/* Optional processing steps applied after BuildFromTriMesh. They change the cached data, so they are part of the mesh cache key. */
+enum MeshBuildOptions : uint64_t
+{
+    MESH_BUILD_OPTIMIZE_VERTEX_ORDER = 1 << 0
+};
+
+/* Render ready indexed mesh, either built from a cy::TriMesh or pointing into a memory mapped mesh cache.
+   Indices are 16-bit when every vertex can be addressed with them and 32-bit otherwise. */
+class MeshData {
+    public:
+        const MeshVertex* vertices = nullptr;
+        size_t vertexCount = 0;
+        const void* indices = nullptr;
+        size_t indexCount = 0;
+        unsigned int indexSize = 4;
+        const MeshMaterial* materials = nullptr;
+        size_t materialCount = 0;
+        cy::Vec3f boundMin = cy::Vec3f(0, 0, 0);
+        cy::Vec3f boundMax = cy::Vec3f(0, 0, 0);
+
+        MeshData() = default;
+        MeshData(const MeshData&) = delete;
+        MeshData& operator=(const MeshData&) = delete;
+
+        /* Turn every face corner into an index of a unique (position, normal, uv) vertex, with faces grouped by material.
+           A mesh without materials gets none, its faces are drawn with a default material.
+           Fails on out of range face indices or on names too long for MeshMaterial. */
+        bool BuildFromTriMesh(cy::TriMesh& mesh)
+        {
+            if ( !(mesh.HasNormals() && mesh.HasTextureVertices()) ) { return false; }
+
+            mesh.ComputeBoundingBox();
+            boundMin = mesh.GetBoundMin();
+            boundMax = mesh.GetBoundMax();
+
+            // Corners are hashed by their position index. Each position keeps a short chain of the unique vertices that share it.
+            const uint32_t chainEnd = 0xFFFFFFFFu;
+            std::vector<uint32_t> firstWithPosition(mesh.NV(), chainEnd);
+            std::vector<uint32_t> nextWithPosition;
+            std::vector<uint32_t> vertexNormalIndex;
+            std::vector<uint32_t> vertexUvIndex;
+            size_t cornerCount = static_cast<size_t>(mesh.NF()) * 3;
+            size_t expectedVertexCount = std::max(mesh.NV(), std::max(mesh.NVN(), mesh.NVT()));
+            _vertices.clear();
+            _vertices.reserve(expectedVertexCount);
+            nextWithPosition.reserve(expectedVertexCount);
+            vertexNormalIndex.reserve(expectedVertexCount);
+            vertexUvIndex.reserve(expectedVertexCount);
+            std::vector<uint32_t> indices32(cornerCount);
+
+            for (unsigned int faceIndex = 0; faceIndex < mesh.NF(); faceIndex++)
+            {
+                const cy::TriMesh::TriFace& facePositions = mesh.F(faceIndex);
+                const cy::TriMesh::TriFace& faceNormals = mesh.FN(faceIndex);
+                const cy::TriMesh::TriFace& faceUvs = mesh.FT(faceIndex);
+                for (int indexOnFace = 0; indexOnFace < 3; indexOnFace++)
+                {
+                    uint32_t positionIndex = facePositions.v[indexOnFace];
+                    uint32_t normalIndex = faceNormals.v[indexOnFace];
+                    uint32_t uvIndex = faceUvs.v[indexOnFace];
+                    if (positionIndex >= mesh.NV() || normalIndex >= mesh.NVN() || uvIndex >= mesh.NVT()) { return false; }
+
+                    uint32_t vertexIndex = firstWithPosition[positionIndex];
+                    while (vertexIndex != chainEnd && (vertexNormalIndex[vertexIndex] != normalIndex || vertexUvIndex[vertexIndex] != uvIndex))
+                    {
+                        vertexIndex = nextWithPosition[vertexIndex];
+                    }
+                    if (vertexIndex == chainEnd)
+                    {
+                        vertexIndex = static_cast<uint32_t>(_vertices.size());
+                        MeshVertex vertex;
+                        vertex.position = mesh.V(positionIndex);
+                        vertex.normal = mesh.VN(normalIndex);
+                        vertex.uv = cy::Vec2f(mesh.VT(uvIndex));
+                        _vertices.push_back(vertex);
+                        vertexNormalIndex.push_back(normalIndex);
+                        vertexUvIndex.push_back(uvIndex);
+                        nextWithPosition.push_back(firstWithPosition[positionIndex]);
+                        firstWithPosition[positionIndex] = vertexIndex;
+                    }
+                    indices32[static_cast<size_t>(faceIndex)*3 + indexOnFace] = vertexIndex;
+                }
+            }
+            setIndices(indices32, _vertices.size());
+
+            _materials.resize(mesh.NM());
+            for (unsigned int materialIndex = 0; materialIndex < mesh.NM(); materialIndex++)
+            {
+                const cy::TriMesh::Mtl& mtl = mesh.M(materialIndex);
+                MeshMaterial& material = _materials[materialIndex];
+                memset(&material, 0, sizeof(MeshMaterial));
+                memcpy(material.Ka, mtl.Ka, sizeof(material.Ka));
+                memcpy(material.Kd, mtl.Kd, sizeof(material.Kd));
+                memcpy(material.Ks, mtl.Ks, sizeof(material.Ks));
+                material.Ns = mtl.Ns;
+                material.firstIndex = static_cast<unsigned int>(mesh.GetMaterialFirstFace(materialIndex)) * 3;
+                material.indexCount = static_cast<unsigned int>(mesh.GetMaterialFaceCount(materialIndex)) * 3;
+                bool namesFit = copyName(material.name, mtl.name.data)
+                    && copyName(material.mapKa, mtl.map_Ka.data)
+                    && copyName(material.mapKd, mtl.map_Kd.data)
+                    && copyName(material.mapKs, mtl.map_Ks.data);
+                if (!namesFit) { return false; }
+            }
+
+            vertices = _vertices.data();
+            vertexCount = _vertices.size();
+            materials = _materials.data();
+            materialCount = _materials.size();
+            return true;
+        }
+
+        /* Point at data owned elsewhere, such as a memory mapped file kept alive by the caller */
+        void SetExternal(const MeshVertex* externalVertices, size_t externalVertexCount, const void* externalIndices, size_t externalIndexCount, unsigned int externalIndexSize,
+                         const MeshMaterial* externalMaterials, size_t externalMaterialCount)
+        {
+            _vertices.clear();
+            _indexBytes.clear();
+            _materials.clear();
+            vertices = externalVertices;
+            vertexCount = externalVertexCount;
+            indices = externalIndices;
+            indexCount = externalIndexCount;
+            indexSize = externalIndexSize;
+            materials = externalMaterials;
+            materialCount = externalMaterialCount;
+        }
+
+        /* Reorder the triangles inside each material range for a post-transform vertex cache of cacheSize entries, then the vertices in order of first use.
+           The triangle order is kept if the simulated cache shows it is already better. Only meshes built by BuildFromTriMesh own their data and can be reordered. */
+        bool OptimizeVertexOrder(unsigned int cacheSize = 16)
+        {
+            if (_vertices.empty() || vertices != _vertices.data()) { return false; }
+            std::vector<uint32_t> originalIndices32 = GetIndices32();
+            std::vector<uint32_t> indices32 = originalIndices32;
+
+            // Faces outside every material are reordered as ranges of their own
+            std::vector<uint32_t> localVertex;
+            size_t rangeStart = 0;
+            for (const MeshMaterial& material : _materials)
+            {
+                if (material.firstIndex > rangeStart) { MeshOptimizer::OptimizeVertexCache(indices32, rangeStart, material.firstIndex - rangeStart, vertexCount, cacheSize, localVertex); }
+                MeshOptimizer::OptimizeVertexCache(indices32, material.firstIndex, material.indexCount, vertexCount, cacheSize, localVertex);
+                rangeStart = std::max(rangeStart, static_cast<size_t>(material.firstIndex) + material.indexCount);
+            }
+            if (indexCount > rangeStart) { MeshOptimizer::OptimizeVertexCache(indices32, rangeStart, indexCount - rangeStart, vertexCount, cacheSize, localVertex); }
+            if (MeshOptimizer::SimulateVertexCache(indices32, vertexCount, cacheSize).acmr >= MeshOptimizer::SimulateVertexCache(originalIndices32, vertexCount, cacheSize).acmr)
+            {
+                indices32.swap(originalIndices32);
+            }
+
+            std::vector<uint32_t> remap = MeshOptimizer::OptimizeVertexFetch(indices32, vertexCount);
+            std::vector<MeshVertex> reorderedVertices(vertexCount);
+            for (size_t i = 0; i < vertexCount; i++) { reorderedVertices[remap[i]] = _vertices[i]; }
+            _vertices.swap(reorderedVertices);
+            vertices = _vertices.data();
+            setIndices(indices32, _vertices.size());
+            return true;
+        }
+
+        /* Coarser level of detail of source made by clustering its vertices on a grid with gridResolution cells along the longest side of its bounds.
+           Each cluster collapses into its vertex nearest to the mean position of the cluster and triangles left with fewer than three clusters are dropped.
+           The vertices are those of source, which has to outlive this mesh, only the indices and the material ranges are owned. */
+        void BuildSimplified(const MeshData& source, unsigned int gridResolution)
+        {
+            const uint32_t noCluster = 0xFFFFFFFFu;
+            cy::Vec3f size = source.boundMax - source.boundMin;
+            float cellSize = std::max(size[size.MaxComp()], 1e-20f) / std::max(1u, gridResolution);
+            std::vector<uint32_t> sourceIndices = source.GetIndices32();
+
+            // Cells are keyed by their 21-bit coordinates, only the cells holding referenced vertices become clusters
+            std::unordered_map<uint64_t, uint32_t> clusterOfCell;
+            std::vector<uint32_t> vertexCluster(source.vertexCount, noCluster);
+            std::vector<cy::Vec3f> clusterSum;
+            std::vector<uint32_t> clusterSize;
+            for (uint32_t vertex : sourceIndices)
+            {
+                if (vertexCluster[vertex] != noCluster) { continue; }
+                cy::Vec3f cell = (source.vertices[vertex].position - source.boundMin) / cellSize;
+                uint64_t key = 0;
+                for (int axis = 0; axis < 3; axis++) { key |= static_cast<uint64_t>(std::min(std::max(cell[axis], 0.0f), static_cast<float>(0x1FFFFF))) << (21*axis); }
+                auto inserted = clusterOfCell.emplace(key, static_cast<uint32_t>(clusterSum.size()));
+                if (inserted.second)
+                {
+                    clusterSum.push_back(cy::Vec3f(0, 0, 0));
+                    clusterSize.push_back(0);
+                }
+                vertexCluster[vertex] = inserted.first->second;
+                clusterSum[inserted.first->second] += source.vertices[vertex].position;
+                clusterSize[inserted.first->second]++;
+            }
+            std::vector<uint32_t> clusterVertex(clusterSum.size(), noCluster);
+            std::vector<float> clusterDistance(clusterSum.size(), 0.0f);
+            for (uint32_t vertex = 0; vertex < source.vertexCount; vertex++)
+            {
+                uint32_t cluster = vertexCluster[vertex];
+                if (cluster == noCluster) { continue; }
+                float distance = (source.vertices[vertex].position - clusterSum[cluster]/static_cast<float>(clusterSize[cluster])).LengthSquared();
+                if (clusterVertex[cluster] == noCluster || distance < clusterDistance[cluster])
+                {
+                    clusterVertex[cluster] = vertex;
+                    clusterDistance[cluster] = distance;
+                }
+            }
+
+            // Ranges are rewritten in index buffer order, faces outside every material stay outside them
+            _vertices.clear();
+            _materials.assign(source.materials, source.materials + source.materialCount);
+            std::vector<size_t> materialOrder(_materials.size());
+            for (size_t m = 0; m < materialOrder.size(); m++) { materialOrder[m] = m; }
+            std::sort(materialOrder.begin(), materialOrder.end(), [&](size_t a, size_t b) { return _materials[a].firstIndex < _materials[b].firstIndex; });
+            std::vector<uint32_t> indices32;
+            auto simplifyRange = [&](size_t first, size_t count)
+            {
+                size_t end = std::min(first + count, sourceIndices.size()) / 3 * 3;
+                for (size_t i = first; i + 3 <= end; i += 3)
+                {
+                    uint32_t a = vertexCluster[sourceIndices[i]], b = vertexCluster[sourceIndices[i + 1]], c = vertexCluster[sourceIndices[i + 2]];
+                    if (a == b || b == c || a == c) { continue; }
+                    indices32.insert(indices32.end(), { clusterVertex[a], clusterVertex[b], clusterVertex[c] });
+                }
+            };
+            size_t rangeStart = 0;
+            for (size_t m : materialOrder)
+            {
+                MeshMaterial& material = _materials[m];
+                size_t sourceFirst = material.firstIndex;
+                if (sourceFirst > rangeStart) { simplifyRange(rangeStart, sourceFirst - rangeStart); }
+                material.firstIndex = static_cast<unsigned int>(indices32.size());
+                simplifyRange(sourceFirst, material.indexCount);
+                material.indexCount = static_cast<unsigned int>(indices32.size() - material.firstIndex);
+                rangeStart = std::max(rangeStart, sourceFirst + source.materials[m].indexCount);
+            }
+            if (source.indexCount > rangeStart) { simplifyRange(rangeStart, source.indexCount - rangeStart); }
+
+            setIndices(indices32, source.vertexCount);
+            vertices = source.vertices;
+            vertexCount = source.vertexCount;
+            materials = _materials.data();
+            materialCount = _materials.size();
+            boundMin = source.boundMin;
+            boundMax = source.boundMax;
+        }
+
+        std::vector<uint32_t> GetIndices32() const
+        {
+            std::vector<uint32_t> indices32(indexCount);
+            if (indexSize == 2)
+            {
+                const uint16_t* indices16 = static_cast<const uint16_t*>(indices);
+                for (size_t i = 0; i < indexCount; i++) { indices32[i] = indices16[i]; }
+            }
+            else if (indexCount > 0)
+            {
+                memcpy(indices32.data(), indices, indexCount*sizeof(uint32_t));
+            }
+            return indices32;
+        }
+
+        VertexCacheStats SimulateVertexCache(unsigned int cacheSize = 32, MeshOptimizer::CacheModel model = MeshOptimizer::CacheModel::Fifo) const
+        {
+            return MeshOptimizer::SimulateVertexCache(GetIndices32(), vertexCount, cacheSize, model);
+        }
+
+        size_t VertexBytes() const { return vertexCount*sizeof(MeshVertex); }
+        size_t IndexBytes() const { return indexCount*indexSize; }
+
+        /* Compare the indexed mesh against drawing one vertex per face corner */
+        void PrintIndexingStats(std::ostream& outStream) const
+        {
+            size_t expandedBytes = indexCount*sizeof(MeshVertex);
+            size_t indexedBytes = VertexBytes() + IndexBytes();
+            double dedupRatio = vertexCount > 0 ? static_cast<double>(indexCount) / vertexCount : 0.0;
+            outStream << "Mesh indexing: " << vertexCount << " unique vertices for " << indexCount << " face corners (" << dedupRatio << "x dedup), "
+                      << indexSize*8 << "-bit indices, " << indexedBytes << " bytes instead of " << expandedBytes
+                      << " (" << (expandedBytes > indexedBytes ? expandedBytes - indexedBytes : 0) << " bytes saved)" << std::endl;
+        }
+
+    private:
+        std::vector<MeshVertex> _vertices;
+        std::vector<unsigned char> _indexBytes;
+        std::vector<MeshMaterial> _materials;
+
+        void setIndices(const std::vector<uint32_t>& indices32, size_t addressedVertexCount)
+        {
+            indexSize = addressedVertexCount <= 0x10000 ? 2 : 4;
+            indexCount = indices32.size();
+            _indexBytes.resize(indexCount*indexSize);
+            if (indexSize == 2)
+            {
+                uint16_t* indices16 = reinterpret_cast<uint16_t*>(_indexBytes.data());
+                for (size_t i = 0; i < indexCount; i++) { indices16[i] = static_cast<uint16_t>(indices32[i]); }
+            }
+            else if (indexCount > 0)
+            {
+                memcpy(_indexBytes.data(), indices32.data(), indexCount*sizeof(uint32_t));
+            }
+            indices = _indexBytes.data();
+        }
+
+        static bool copyName(char (&destination)[MeshMaterial::NAME_LENGTH], const char* source)
+        {
+            if (!source) { return true; }
+            size_t length = strlen(source);
+            if (length >= MeshMaterial::NAME_LENGTH) { return false; }
+            memcpy(destination, source, length + 1);
+            return true;
+        }
+};
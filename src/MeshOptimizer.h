@@ -0,0 +1,186 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/* Post-transform vertex cache results of an index buffer */
+struct VertexCacheStats
+{
+    double acmr = 0.0;  // average cache miss ratio, vertex shader runs per triangle (0.5 is ideal for large meshes, 3 is the worst)
+    double atvr = 0.0;  // average transformed vertex ratio, vertex shader runs per referenced vertex (1 is ideal)
+};
+
+/* Triangle and vertex reordering for GPU vertex cache and vertex fetch locality */
+class MeshOptimizer {
+    public:
+        enum class CacheModel { Fifo, Lru };
+
+        /* Count the vertex shader runs of a CPU simulated post-transform cache */
+        static VertexCacheStats SimulateVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned int cacheSize = 32, CacheModel model = CacheModel::Fifo)
+        {
+            VertexCacheStats stats;
+            if (indices.empty() || cacheSize == 0) { return stats; }
+
+            size_t misses = 0;
+            size_t referencedVertices = 0;
+            std::vector<bool> referenced(vertexCount, false);
+            if (model == CacheModel::Fifo)
+            {
+                // A vertex is still cached if fewer than cacheSize misses happened since the miss that inserted it
+                std::vector<size_t> insertedAt(vertexCount, 0);
+                for (uint32_t vertex : indices)
+                {
+                    if (insertedAt[vertex] == 0 || misses - insertedAt[vertex] >= cacheSize)
+                    {
+                        misses++;
+                        insertedAt[vertex] = misses;
+                    }
+                    if (!referenced[vertex]) { referenced[vertex] = true; referencedVertices++; }
+                }
+            }
+            else
+            {
+                std::vector<uint32_t> cache;
+                cache.reserve(cacheSize + 1);
+                for (uint32_t vertex : indices)
+                {
+                    auto cached = std::find(cache.begin(), cache.end(), vertex);
+                    if (cached == cache.end())
+                    {
+                        misses++;
+                        cache.insert(cache.begin(), vertex);
+                        if (cache.size() > cacheSize) { cache.pop_back(); }
+                    }
+                    else
+                    {
+                        std::rotate(cache.begin(), cached, cached + 1);
+                    }
+                    if (!referenced[vertex]) { referenced[vertex] = true; referencedVertices++; }
+                }
+            }
+            stats.acmr = static_cast<double>(misses) / (indices.size() / 3);
+            stats.atvr = referencedVertices > 0 ? static_cast<double>(misses) / referencedVertices : 0.0;
+            return stats;
+        }
+
+        /* Reorder the triangles in indices[first, first+count) with Tipsify (Sander, Nehab, and Barczak 2007).
+           Triangles never leave the range, so material ranges of the index buffer stay intact. */
+        static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t first, size_t count, size_t vertexCount, unsigned int cacheSize = 16)
+        {
+            std::vector<uint32_t> localVertex;
+            OptimizeVertexCache(indices, first, count, vertexCount, cacheSize, localVertex);
+        }
+
+        /* Same as above with the caller's scratch space for numbering the vertices of the range, so optimizing many ranges of one
+           mesh allocates it once. It is left ready for the next range. */
+        static void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t first, size_t count, size_t vertexCount, unsigned int cacheSize,
+                                        std::vector<uint32_t>& localVertex)
+        {
+            size_t triangleCount = count / 3;
+            if (triangleCount < 2) { return; }
+            uint32_t* rangeIndices = indices.data() + first;
+
+            // Number the vertices of the range locally so the work stays proportional to the range
+            const uint32_t unused = 0xFFFFFFFFu;
+            if (localVertex.size() < vertexCount) { localVertex.resize(vertexCount, unused); }
+            std::vector<uint32_t> globalVertex;
+            std::vector<uint32_t> local(triangleCount*3);
+            for (size_t i = 0; i < triangleCount*3; i++)
+            {
+                uint32_t& localIndex = localVertex[rangeIndices[i]];
+                if (localIndex == unused)
+                {
+                    localIndex = static_cast<uint32_t>(globalVertex.size());
+                    globalVertex.push_back(rangeIndices[i]);
+                }
+                local[i] = localIndex;
+            }
+            for (uint32_t vertex : globalVertex) { localVertex[vertex] = unused; }
+            size_t localVertexCount = globalVertex.size();
+
+            // Triangles around each vertex
+            std::vector<uint32_t> liveTriangles(localVertexCount, 0);
+            for (uint32_t vertex : local) { liveTriangles[vertex]++; }
+            std::vector<uint32_t> adjacencyOffset(localVertexCount + 1, 0);
+            for (size_t v = 0; v < localVertexCount; v++) { adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v]; }
+            std::vector<uint32_t> adjacency(triangleCount*3);
+            std::vector<uint32_t> adjacencyFill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+            for (size_t i = 0; i < triangleCount*3; i++) { adjacency[adjacencyFill[local[i]]++] = static_cast<uint32_t>(i / 3); }
+
+            std::vector<uint32_t> cacheTime(localVertexCount, 0);
+            std::vector<bool> emitted(triangleCount, false);
+            std::vector<uint32_t> deadEnd;
+            std::vector<uint32_t> candidates;
+            std::vector<uint32_t> output;
+            output.reserve(triangleCount*3);
+            uint32_t timeStamp = cacheSize + 1;
+            size_t cursor = 0;
+
+            int64_t fanVertex = local[0];
+            while (fanVertex >= 0)
+            {
+                candidates.clear();
+                for (uint32_t a = adjacencyOffset[fanVertex]; a < adjacencyOffset[fanVertex + 1]; a++)
+                {
+                    uint32_t triangle = adjacency[a];
+                    if (emitted[triangle]) { continue; }
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        uint32_t vertex = local[triangle*3 + corner];
+                        output.push_back(globalVertex[vertex]);
+                        deadEnd.push_back(vertex);
+                        candidates.push_back(vertex);
+                        liveTriangles[vertex]--;
+                        if (timeStamp - cacheTime[vertex] > cacheSize) { cacheTime[vertex] = timeStamp++; }
+                    }
+                    emitted[triangle] = true;
+                }
+
+                // Prefer the candidate that stays in the cache while its remaining triangles are emitted
+                fanVertex = -1;
+                int64_t bestPriority = -1;
+                for (uint32_t vertex : candidates)
+                {
+                    if (liveTriangles[vertex] == 0) { continue; }
+                    int64_t priority = 0;
+                    if (timeStamp - cacheTime[vertex] + 2*liveTriangles[vertex] <= cacheSize) { priority = timeStamp - cacheTime[vertex]; }
+                    if (priority > bestPriority) { bestPriority = priority; fanVertex = vertex; }
+                }
+                if (fanVertex >= 0) { continue; }
+
+                // Dead end: go back to a recently used vertex, otherwise to the next triangle in input order
+                while (!deadEnd.empty() && fanVertex < 0)
+                {
+                    uint32_t vertex = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (liveTriangles[vertex] > 0) { fanVertex = vertex; }
+                }
+                while (fanVertex < 0 && cursor < triangleCount)
+                {
+                    if (!emitted[cursor]) { fanVertex = local[cursor*3]; }
+                    cursor++;
+                }
+            }
+            std::copy(output.begin(), output.end(), rangeIndices);
+        }
+
+        /* Renumber the vertices in the order the index buffer first uses them. Unused vertices move to the end.
+           Returns the new index of every old vertex. */
+        static std::vector<uint32_t> OptimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount)
+        {
+            const uint32_t unassigned = 0xFFFFFFFFu;
+            std::vector<uint32_t> remap(vertexCount, unassigned);
+            uint32_t nextVertex = 0;
+            for (uint32_t& index : indices)
+            {
+                if (remap[index] == unassigned) { remap[index] = nextVertex++; }
+                index = remap[index];
+            }
+            for (uint32_t& newIndex : remap)
+            {
+                if (newIndex == unassigned) { newIndex = nextVertex++; }
+            }
+            return remap;
+        }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "cyMatrix.h"
+#include "cyQuat.h"
+#include "cyVector.h"
+
+/* An object circling the origin, such as the camera or the light, turned by the mouse or an OrbitPath */
+class OrbitalObject {
+    public:
+        float radius = 3.0;
+        float radialSpeed = 2.0;
+        cy::Vec3f worldX = cy::Vec3f(1, 0, 0);
+        cy::Vec3f worldY = cy::Vec3f(0, 1, 0);
+        cy::Vec3f worldZ = cy::Vec3f(0, 0, 1);
+        cy::Quatf currentOrientation = cy::Quatf(1, 0, 0, 0);
+        cy::Vec3f currentPosition = cy::Vec3f(0, 0, radius);
+
+        void update(float phiDelta, float thetaDelta, float radiusDelta)
+        {
+            cy::Vec3f thetaDirection = (currentOrientation.ToMatrix3() * worldX).GetNormalized();
+            cy::Vec3f phiDirection = worldY;
+
+            cy::Quatf rotationTheta;
+            cy::Quatf rotationPhi;
+            rotationTheta.SetRotation(thetaDelta, thetaDirection);
+            rotationPhi.SetRotation(phiDelta, phiDirection);
+            currentOrientation = rotationPhi * rotationTheta * currentOrientation;
+            currentOrientation.Normalize();
+
+            cy::Vec3f radiusDirection = (currentOrientation.ToMatrix3() * worldZ).GetNormalized();
+            radius = cy::Max(0.0f, radialSpeed*radiusDelta + radius);
+            currentPosition = radius*radiusDirection;
+        }
+        cy::Matrix4f getViewMatrix()
+        {
+            cy::Matrix4f positionTranslation = cy::Matrix4f::Translation(currentPosition);
+            cy::Matrix4f orientationRotation = currentOrientation.ToMatrix4();
+            return (positionTranslation * orientationRotation).GetInverse();
+        }
+        cy::Matrix4f getModelMatrix()
+        {
+            cy::Matrix4f positionTranslation = cy::Matrix4f::Translation(currentPosition);
+            cy::Matrix4f orientationRotation = currentOrientation.ToMatrix4();
+            return (positionTranslation * orientationRotation);
+        }
+};
+
+/* The deltas of one frame passed to OrbitalObject::update for the camera and the light */
+struct OrbitStep
+{
+    float cameraPhiDelta = 0.0f;
+    float cameraThetaDelta = 0.0f;
+    float cameraRadiusDelta = 0.0f;
+    float lightPhiDelta = 0.0f;
+    float lightThetaDelta = 0.0f;
+};
+
+/* A scripted replacement for the mouse so runs can be repeated exactly. Over frameCount frames the camera circles the origin once
+   while tilting up and down by about 20 degrees and moving in and out by half a unit, and the light circles the other way twice.
+   The tilt and distance return to where they started at the last frame. */
+class OrbitPath {
+    public:
+        explicit OrbitPath(unsigned int frameCount) : _frameCount(std::max(1u, frameCount)) { }
+
+        unsigned int FrameCount() const { return _frameCount; }
+
+        OrbitStep Step(unsigned int frame) const
+        {
+            // The tilt and distance follow sines of the path position, so each step moves by the difference between two frames
+            float turn = 2.0f*cy::Pi<float>() / _frameCount;
+            float phase = turn*(frame % _frameCount);
+            float nextPhase = phase + turn;
+            OrbitStep step;
+            step.cameraPhiDelta = turn;
+            step.cameraThetaDelta = 0.35f*(std::sin(nextPhase) - std::sin(phase));
+            step.cameraRadiusDelta = 0.25f*(std::sin(2.0f*nextPhase) - std::sin(2.0f*phase));
+            step.lightPhiDelta = -2.0f*turn;
+            return step;
+        }
+
+    private:
+        unsigned int _frameCount;
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Rolling window of the last sample times, such as frame times in milliseconds */
+class FrameStatistics {
+    public:
+        explicit FrameStatistics(size_t windowSize = 240) : _windowSize(std::max<size_t>(1, windowSize)) { }
+
+        void Add(double value)
+        {
+            if (_samples.size() < _windowSize) { _samples.push_back(value); }
+            else { _samples[_next] = value; }
+            _next = (_next + 1) % _windowSize;
+        }
+
+        size_t Count() const { return _samples.size(); }
+        double Min() const { return _samples.empty() ? 0.0 : *std::min_element(_samples.begin(), _samples.end()); }
+        double Max() const { return _samples.empty() ? 0.0 : *std::max_element(_samples.begin(), _samples.end()); }
+
+        double Average() const
+        {
+            double sum = 0.0;
+            for (double sample : _samples) { sum += sample; }
+            return _samples.empty() ? 0.0 : sum / _samples.size();
+        }
+
+        /* Nearest rank percentile, 0.99 for p99 */
+        double Percentile(double fraction) const
+        {
+            if (_samples.empty()) { return 0.0; }
+            std::vector<double> sorted = _samples;
+            size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(fraction*sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            return sorted[rank];
+        }
+
+    private:
+        size_t _windowSize;
+        size_t _next = 0;
+        std::vector<double> _samples;
+};
+
+/* Named time spans of the CPU threads and the GPU, kept while recording and written as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+   Spans can be recorded from any thread. */
+class Profiler {
+    public:
+        using Clock = std::chrono::steady_clock;
+        static constexpr uint32_t GPU_LANE = 1000;  // trace thread of the GPU spans, above any CPU thread lane
+        static constexpr size_t MAX_EVENTS = 1 << 19;  // recording stops at this many spans so long sessions do not grow without bound
+
+        struct Event
+        {
+            std::string name;
+            const char* category;
+            uint32_t lane;
+            double startMicroseconds;
+            double durationMicroseconds;
+        };
+
+        /* Measures from construction until Stop or destruction and records the span if the profiler is recording */
+        class Scope {
+            public:
+                Scope(Profiler& profiler, const char* name, const char* category = "cpu") : _profiler(profiler), _name(name), _category(category), _start(Clock::now()) { }
+                ~Scope() { Stop(); }
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+                /* Milliseconds since construction, recorded once */
+                double Stop()
+                {
+                    if (!_stopped)
+                    {
+                        _end = Clock::now();
+                        _stopped = true;
+                        if (_profiler.IsRecording()) { _profiler.Record(_name, _category, _start, _end); }
+                    }
+                    return std::chrono::duration<double, std::milli>(_end - _start).count();
+                }
+
+            private:
+                Profiler& _profiler;
+                const char* _name;
+                const char* _category;
+                Clock::time_point _start;
+                Clock::time_point _end;
+                bool _stopped = false;
+        };
+
+        /* Spans are timed relative to origin, and the constructing thread is named the main thread in traces */
+        explicit Profiler(Clock::time_point origin = Clock::now()) : _origin(origin) { laneOf(std::this_thread::get_id()); }
+
+        /* Spans are only kept while recording, timing them costs the same either way */
+        void SetRecording(bool recording) { _recording = recording; }
+        bool IsRecording() const { return _recording; }
+
+        /* Record a span of the calling thread */
+        void Record(const std::string& name, const char* category, Clock::time_point start, Clock::time_point end)
+        {
+            if (!_recording) { return; }
+            Record(name, category, start, end, std::this_thread::get_id());
+        }
+
+        /* Record a span that ran on another thread, such as a texture decoded on a thread pool */
+        void Record(const std::string& name, const char* category, Clock::time_point start, Clock::time_point end, std::thread::id thread)
+        {
+            if (!_recording) { return; }
+            std::lock_guard<std::mutex> lock(_mutex);
+            addEvent(name, category, laneOf(thread), start, std::chrono::duration<double, std::micro>(end - start).count());
+        }
+
+        /* Record a GPU span measured by a timer query. The GPU only reports durations, so the span is placed at the CPU time its commands were issued. */
+        void RecordGPU(const std::string& name, Clock::time_point issued, double milliseconds)
+        {
+            if (!_recording) { return; }
+            std::lock_guard<std::mutex> lock(_mutex);
+            addEvent(name, "gpu", GPU_LANE, issued, milliseconds*1000.0);
+        }
+
+        size_t EventCount()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _events.size();
+        }
+
+        /* True once spans were dropped because MAX_EVENTS were recorded */
+        bool EventLimitReached()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _eventLimitReached;
+        }
+
+        /* Write the recorded spans in the Chrome trace event format */
+        bool WriteChromeTrace(const std::string& filePath, std::ostream* errorStream = nullptr)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::ofstream file(filePath, std::ios::binary);
+            if (!file)
+            {
+                if (errorStream) { *errorStream << "Could not write trace file " << filePath << std::endl; }
+                return false;
+            }
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            bool first = true;
+            auto threadName = [&](uint32_t lane, const std::string& name)
+            {
+                file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << lane << ",\"args\":{\"name\":\"" << escape(name) << "\"}}";
+                first = false;
+            };
+            for (uint32_t lane = 0; lane < _lanes.size(); lane++) { threadName(lane, lane == 0 ? "Main" : "Worker " + std::to_string(lane)); }
+            threadName(GPU_LANE, "GPU");
+            char numbers[64];
+            for (const Event& event : _events)
+            {
+                snprintf(numbers, sizeof(numbers), "%.3f,\"dur\":%.3f", event.startMicroseconds, event.durationMicroseconds);
+                file << ",\n{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.lane << ",\"ts\":" << numbers << "}";
+            }
+            file << "\n]}\n";
+            if (!file)
+            {
+                if (errorStream) { *errorStream << "Could not write trace file " << filePath << std::endl; }
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        Clock::time_point _origin;
+        bool _recording = false;
+        bool _eventLimitReached = false;
+        std::mutex _mutex;
+        std::vector<Event> _events;
+        std::map<std::thread::id, uint32_t> _lanes;  // threads in order of their first span, lane 0 is the thread that made the profiler
+
+        uint32_t laneOf(std::thread::id thread)
+        {
+            return _lanes.emplace(thread, static_cast<uint32_t>(_lanes.size())).first->second;
+        }
+
+        void addEvent(const std::string& name, const char* category, uint32_t lane, Clock::time_point start, double durationMicroseconds)
+        {
+            if (_events.size() >= MAX_EVENTS)
+            {
+                _eventLimitReached = true;
+                return;
+            }
+            _events.push_back({ name, category, lane, std::chrono::duration<double, std::micro>(start - _origin).count(), durationMicroseconds });
+        }
+
+        static std::string escape(const std::string& text)
+        {
+            std::string escaped;
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\') { escaped += '\\'; escaped += c; }
+                else if (static_cast<unsigned char>(c) < 0x20) { escaped += ' '; }
+                else { escaped += c; }
+            }
+            return escaped;
+        }
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "cyMatrix.h"
+#include "cyQuat.h"
+#include "cyVector.h"
+
+/* Placement of one copy of the mesh, in the layout of the per-instance vertex attributes of vertShader.vert.
+   The vertex shader builds the instance model matrix from it, so it takes half the memory of a matrix. */
+struct InstanceTransform
+{
+    float translationScale[4];  // world position and uniform scale
+    float rotation[4];          // unit quaternion x, y, z, w
+
+    InstanceTransform(const cy::Vec3f& translation = cy::Vec3f(0, 0, 0), float scale = 1.0f, const cy::Quatf& orientation = cy::Quatf(1, 0, 0, 0))
+        : translationScale{ translation.x, translation.y, translation.z, scale }, rotation{ orientation.v.x, orientation.v.y, orientation.v.z, orientation.s } { }
+
+    cy::Vec3f Translation() const { return cy::Vec3f(translationScale[0], translationScale[1], translationScale[2]); }
+    float Scale() const { return translationScale[3]; }
+    cy::Quatf Rotation() const { return cy::Quatf(rotation[3], rotation[0], rotation[1], rotation[2]); }
+
+    /* The matrix vertShader.vert builds for this instance */
+    cy::Matrix4f Matrix() const
+    {
+        return cy::Matrix4f(Rotation().ToMatrix3() * Scale(), Translation());
+    }
+};
+static_assert(sizeof(InstanceTransform) == 32, "InstanceTransform must match the per-instance vertex attributes");
+
+/* Transforms of every copy of the mesh in the scene */
+class SceneLayout {
+    public:
+        std::vector<InstanceTransform> instances;
+
+        /* Model matrix of a z up mesh with the given bounds, moved to the origin, scaled, and turned y up */
+        static cy::Matrix4f ModelMatrix(const cy::Vec3f& boundMin, const cy::Vec3f& boundMax, float scale)
+        {
+            cy::Vec3f center = (boundMax + boundMin)/2;
+            return cy::Matrix4f::RotationY(cy::Pi<float>()/2) * cy::Matrix4f::RotationX(-cy::Pi<float>()/2) * cy::Matrix4f::Scale(scale) * cy::Matrix4f::Translation(-center);
+        }
+
+        /* Read a text file with one instance per line: x y z [scale [axisX axisY axisZ angleDegrees]].
+           Blank lines and lines starting with # are skipped. Fails on malformed lines or a file without instances. */
+        bool LoadFromFile(const std::filesystem::path& filePath, std::ostream* errorStream = nullptr)
+        {
+            std::ifstream file(filePath);
+            if (!file)
+            {
+                if (errorStream) { *errorStream << "Could not open scene layout " << filePath.string() << std::endl; }
+                return false;
+            }
+            instances.clear();
+            std::string line;
+            for (size_t lineNumber = 1; std::getline(file, line); lineNumber++)
+            {
+                size_t first = line.find_first_not_of(" \t\r");
+                if (first == std::string::npos || line[first] == '#') { continue; }
+
+                std::istringstream values(line);
+                std::vector<float> numbers;
+                float number;
+                while (values >> number) { numbers.push_back(number); }
+                bool valid = values.eof() && (numbers.size() == 3 || numbers.size() == 4 || numbers.size() == 8);
+                float scale = numbers.size() >= 4 ? numbers[3] : 1.0f;
+                cy::Vec3f axis = numbers.size() == 8 ? cy::Vec3f(numbers[4], numbers[5], numbers[6]) : cy::Vec3f(0, 1, 0);
+                if (!valid || !(scale > 0.0f) || axis.LengthSquared() == 0.0f)
+                {
+                    if (errorStream) { *errorStream << "Malformed instance on line " << lineNumber << " of scene layout " << filePath.string() << ": " << line << std::endl; }
+                    return false;
+                }
+                cy::Quatf orientation(1, 0, 0, 0);
+                if (numbers.size() == 8) { orientation.SetRotation(numbers[7]*cy::Pi<float>()/180.0f, axis); }
+                instances.emplace_back(cy::Vec3f(numbers[0], numbers[1], numbers[2]), scale, orientation);
+            }
+            if (instances.empty() && errorStream) { *errorStream << "Scene layout " << filePath.string() << " has no instances" << std::endl; }
+            return !instances.empty();
+        }
+
+        /* count instances on a square grid in the y = 0 plane centered at the origin, spacing apart */
+        void BuildGrid(size_t count, float spacing)
+        {
+            instances.clear();
+            size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+            float offset = (side - 1)*spacing/2;
+            for (size_t i = 0; i < count; i++)
+            {
+                instances.emplace_back(cy::Vec3f((i % side)*spacing - offset, 0.0f, (i / side)*spacing - offset));
+            }
+        }
+
+        /* Radius around the origin that holds the translations of every instance */
+        float Extent() const
+        {
+            float extent = 0.0f;
+            for (const InstanceTransform& instance : instances) { extent = std::max(extent, instance.Translation().Length()); }
+            return extent;
+        }
+};
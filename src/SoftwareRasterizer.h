@@ -0,0 +1,643 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cyMatrix.h"
+#include "cyVector.h"
+#include "lodepng.h"
+#include "MeshData.h"
+#include "DrawList.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define SOFTWARE_RASTERIZER_SSE2
+#endif
+
+/* RGBA8 texture with a box filtered mip chain, sampled like a GL texture with GL_REPEAT wrapping */
+class RasterTexture {
+    public:
+        /* Rows are stored in the order lodepng decodes them, the same order cy::GLTexture2D::SetImage uploads them */
+        void SetImage(const unsigned char* rgba, unsigned int width, unsigned int height)
+        {
+            _levels.assign(1, Level());
+            _levels[0].width = width;
+            _levels[0].height = height;
+            _levels[0].texels.resize(static_cast<size_t>(width)*height);
+            for (size_t i = 0; i < _levels[0].texels.size(); i++)
+            {
+                for (int c = 0; c < 3; c++) { _levels[0].texels[i][c] = rgba[i*4 + c] / 255.0f; }
+            }
+        }
+
+        void BuildMipmaps()
+        {
+            if (_levels.empty()) { return; }
+            _levels.resize(1);
+            while (_levels.back().width > 1 || _levels.back().height > 1)
+            {
+                const Level& source = _levels.back();
+                Level level;
+                level.width = std::max(1u, source.width / 2);
+                level.height = std::max(1u, source.height / 2);
+                level.texels.resize(static_cast<size_t>(level.width)*level.height);
+                for (unsigned int y = 0; y < level.height; y++)
+                {
+                    for (unsigned int x = 0; x < level.width; x++)
+                    {
+                        unsigned int x0 = std::min(x*2, source.width - 1), x1 = std::min(x*2 + 1, source.width - 1);
+                        unsigned int y0 = std::min(y*2, source.height - 1), y1 = std::min(y*2 + 1, source.height - 1);
+                        level.texels[static_cast<size_t>(y)*level.width + x] = (source.Texel(x0, y0) + source.Texel(x1, y0) + source.Texel(x0, y1) + source.Texel(x1, y1)) * 0.25f;
+                    }
+                }
+                _levels.push_back(std::move(level));
+            }
+        }
+
+        bool IsReady() const { return !_levels.empty() && !_levels[0].texels.empty(); }
+
+        /* Mip level for a footprint of uvArea uv units per pixel, rounded to the nearest level as GL_LINEAR_MIPMAP_NEAREST does */
+        int LevelFor(float uvArea) const
+        {
+            if (_levels.empty() || !(uvArea > 0.0f)) { return 0; }
+            float texelArea = uvArea * _levels[0].width * _levels[0].height;
+            int level = static_cast<int>(std::floor(0.5f*std::log2(texelArea) + 0.5f));
+            return std::clamp(level, 0, static_cast<int>(_levels.size()) - 1);
+        }
+
+        /* Bilinear sample of one mip level */
+        cy::Vec3f Sample(const cy::Vec2f& uv, int levelIndex) const
+        {
+            const Level& level = _levels[levelIndex];
+            float x = uv.x*level.width - 0.5f;
+            float y = uv.y*level.height - 0.5f;
+            float xFloor = std::floor(x);
+            float yFloor = std::floor(y);
+            float xFraction = x - xFloor;
+            float yFraction = y - yFloor;
+            unsigned int x0 = wrap(static_cast<int64_t>(xFloor), level.width), x1 = wrap(static_cast<int64_t>(xFloor) + 1, level.width);
+            unsigned int y0 = wrap(static_cast<int64_t>(yFloor), level.height), y1 = wrap(static_cast<int64_t>(yFloor) + 1, level.height);
+            cy::Vec3f bottom = level.Texel(x0, y0)*(1.0f - xFraction) + level.Texel(x1, y0)*xFraction;
+            cy::Vec3f top = level.Texel(x0, y1)*(1.0f - xFraction) + level.Texel(x1, y1)*xFraction;
+            return bottom*(1.0f - yFraction) + top*yFraction;
+        }
+
+    private:
+        struct Level
+        {
+            unsigned int width = 0;
+            unsigned int height = 0;
+            std::vector<cy::Vec3f> texels;
+
+            const cy::Vec3f& Texel(unsigned int x, unsigned int y) const { return texels[static_cast<size_t>(y)*width + x]; }
+        };
+
+        std::vector<Level> _levels;
+
+        static unsigned int wrap(int64_t coordinate, unsigned int size)
+        {
+            int64_t wrapped = coordinate % static_cast<int64_t>(size);
+            return static_cast<unsigned int>(wrapped < 0 ? wrapped + size : wrapped);
+        }
+};
+
+/* The uniforms vertShader.vert and fragShader.frag read for a float vertex stream */
+struct RasterUniforms
+{
+    cy::Matrix4f mvp;
+    cy::Matrix4f mv;
+    cy::Matrix3f mvNormal;
+    cy::Vec3f lightPosition;  // view space
+    float lightIntensity = 0.9f;
+    float lightAmbientIntensity = 0.1f;
+};
+
+/* The material inputs fragShader.frag reads. A missing texture is replaced by its constant color. */
+struct RasterMaterial
+{
+    const RasterTexture* mapKd = nullptr;
+    const RasterTexture* mapKs = nullptr;
+    const RasterTexture* mapKa = nullptr;
+    cy::Vec3f Kd = cy::Vec3f(0.8f, 0.8f, 0.8f);
+    cy::Vec3f Ks = cy::Vec3f(0.0f, 0.0f, 0.0f);
+    cy::Vec3f Ka = cy::Vec3f(0.8f, 0.8f, 0.8f);
+    float Ns = 1.0f;
+};
+
+/* Indices [firstIndex, firstIndex + indexCount) drawn with one material */
+struct RasterDraw
+{
+    size_t firstIndex = 0;
+    size_t indexCount = 0;
+    const RasterMaterial* material = nullptr;
+};
+
+/* Textures named by the .mtl files of an obj file, decoded from their png files on first use for programs without a TextureLoader.
+   A texture that does not load is reported once and returned as nullptr, so its materials use their constant colors. */
+class RasterTextureFiles {
+    public:
+        explicit RasterTextureFiles(const std::filesystem::path& objFilePath, std::ostream* errorStream = nullptr)
+            : _directory(objFilePath.parent_path()), _errorStream(errorStream) { }
+
+        const RasterTexture* Get(const char* textureName)
+        {
+            std::filesystem::path texturePath = _directory / std::filesystem::path(textureName);
+            // A texture that did not load keeps its empty entry, so it is only tried and reported once
+            auto inserted = _textures.try_emplace(texturePath.lexically_normal().generic_string());
+            std::unique_ptr<RasterTexture>& texture = inserted.first->second;
+            if (!inserted.second) { return texture.get(); }
+            std::vector<unsigned char> textureData;
+            unsigned textureWidth, textureHeight;
+            unsigned pngLodeError = lodepng::decode(textureData, textureWidth, textureHeight, texturePath.string());
+            if (pngLodeError)
+            {
+                if (_errorStream) { *_errorStream << "Could not load texture " << texturePath.string() << ": " << lodepng_error_text(pngLodeError) << ", using the constant colors of the materials naming it instead" << std::endl; }
+                return nullptr;
+            }
+            texture = std::make_unique<RasterTexture>();
+            texture->SetImage(textureData.data(), textureWidth, textureHeight);
+            texture->BuildMipmaps();
+            return texture.get();
+        }
+
+    private:
+        std::filesystem::path _directory;
+        std::ostream* _errorStream;
+        std::map<std::string, std::unique_ptr<RasterTexture>> _textures;
+};
+
+/* CPU implementation of the shader pipeline for machines without a GPU.
+   Triangles are set up and binned into screen tiles on all threads, then every tile is rasterized by one thread
+   with the edge functions and depth test evaluated four pixels at a time. */
+class SoftwareRasterizer {
+    public:
+        static constexpr unsigned int TILE_SIZE = 64;
+
+        /* Every material of meshData followed by the default material of faces outside them, with the constants DrawList::MaterialConstantsOf
+           gives the GPU. textureOf(textureName) returns the texture of a name from the .mtl file, or nullptr to use the constant color instead.
+           map_Ka falls back to the map_Kd texture like in GraphicsProject. */
+        template <typename TextureFunc>
+        static std::vector<RasterMaterial> MaterialsOf(const MeshData& meshData, TextureFunc textureOf)
+        {
+            std::vector<std::array<const RasterTexture*, 3>> materialMaps(meshData.materialCount);
+            for (size_t m = 0; m < meshData.materialCount; m++)
+            {
+                const MeshMaterial& material = meshData.materials[m];
+                const char* textureNames[3] = { material.mapKd, material.mapKs, material.mapKa[0] != '\0' ? material.mapKa : material.mapKd };
+                for (int slot = 0; slot < 3; slot++) { materialMaps[m][slot] = textureNames[slot][0] != '\0' ? textureOf(textureNames[slot]) : nullptr; }
+            }
+            std::vector<MaterialConstants> constants = DrawList::MaterialConstantsOf(meshData, [&](size_t m, uint32_t map)
+            {
+                int slot = map == MaterialConstants::MAP_KD ? 0 : map == MaterialConstants::MAP_KS ? 1 : 2;
+                return materialMaps[m][slot] != nullptr;
+            });
+            std::vector<RasterMaterial> materials(constants.size());
+            for (size_t m = 0; m < constants.size(); m++)
+            {
+                RasterMaterial& material = materials[m];
+                material.Kd = cy::Vec3f(constants[m].Kd);
+                material.Ks = cy::Vec3f(constants[m].Ks);
+                material.Ka = cy::Vec3f(constants[m].Ka);
+                material.Ns = constants[m].Ns;
+                if (m == meshData.materialCount) { continue; }
+                material.mapKd = materialMaps[m][0];
+                material.mapKs = materialMaps[m][1];
+                material.mapKa = materialMaps[m][2];
+            }
+            return materials;
+        }
+
+        /* One draw per material range with the materials returned by MaterialsOf, which have to outlive the draws */
+        static std::vector<RasterDraw> DrawsOf(const std::vector<MaterialRange>& ranges, const std::vector<RasterMaterial>& materials)
+        {
+            std::vector<RasterDraw> draws;
+            for (const MaterialRange& range : ranges)
+            {
+                RasterDraw draw;
+                draw.firstIndex = range.firstIndex;
+                draw.indexCount = range.indexCount;
+                draw.material = &materials[range.materialIndex];
+                draws.push_back(draw);
+            }
+            return draws;
+        }
+
+        /* numThreads of 0 uses all hardware threads. The calling thread works on every pass too, so the pool has one thread less. */
+        void Resize(unsigned int width, unsigned int height, unsigned int numThreads = 0)
+        {
+            _width = width;
+            _height = height;
+            unsigned int threadCount = numThreads > 0 ? numThreads : std::max(1u, std::thread::hardware_concurrency());
+            if (threadCount != _numThreads)
+            {
+                _numThreads = threadCount;
+                _pool = _numThreads > 1 ? std::make_unique<ThreadPool>(_numThreads - 1) : nullptr;
+            }
+            _tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+            _tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+            _color.assign(static_cast<size_t>(width)*height*4, 0);
+            _depth.assign(static_cast<size_t>(_tilesX)*_tilesY*TILE_SIZE*TILE_SIZE, 1.0f);
+            _chunkTriangles.assign(_numThreads, std::vector<RasterTriangle>());
+            _chunkBins.assign(static_cast<size_t>(_numThreads)*_tilesX*_tilesY, std::vector<uint32_t>());
+        }
+
+        void Clear(float red, float green, float blue)
+        {
+            unsigned char clearColor[4] = { toByte(red), toByte(green), toByte(blue), 255 };
+            for (size_t i = 0; i < _color.size(); i += 4) { memcpy(&_color[i], clearColor, 4); }
+            std::fill(_depth.begin(), _depth.end(), 1.0f);
+        }
+
+        /* Draw indices [firstIndex, firstIndex + indexCount) of meshData like glDrawElements with vertShader.vert and fragShader.frag */
+        void DrawIndexed(const MeshData& meshData, size_t firstIndex, size_t indexCount, const RasterUniforms& uniforms, const RasterMaterial& material)
+        {
+            RasterDraw draw;
+            draw.firstIndex = firstIndex;
+            draw.indexCount = indexCount;
+            draw.material = &material;
+            DrawMesh(meshData, std::vector<RasterDraw>(1, draw), uniforms);
+        }
+
+        /* Draw several index ranges of meshData in order, each with its own material.
+           The vertices are shaded once and the triangles of all draws are binned together, so the tiles are rasterized in one pass. */
+        void DrawMesh(const MeshData& meshData, const std::vector<RasterDraw>& draws, const RasterUniforms& uniforms)
+        {
+            if (_width == 0 || _height == 0) { return; }
+
+            // Triangles of all draws are numbered consecutively, drawTriangleEnd[d] is one past the last triangle of draw d
+            std::vector<size_t> drawTriangleEnd;
+            size_t triangleCount = 0;
+            for (const RasterDraw& draw : draws)
+            {
+                if (draw.material) { triangleCount += std::min(draw.indexCount, meshData.indexCount - std::min(draw.firstIndex, meshData.indexCount)) / 3; }
+                drawTriangleEnd.push_back(triangleCount);
+            }
+            if (triangleCount == 0) { return; }
+
+            // Vertex shader
+            _shadedVertices.resize(meshData.vertexCount);
+            parallelFor(meshData.vertexCount, _numThreads, [&](size_t begin, size_t end, unsigned int)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const MeshVertex& vertex = meshData.vertices[i];
+                    ShadedVertex& shaded = _shadedVertices[i];
+                    shaded.clip = uniforms.mvp * cy::Vec4f(vertex.position, 1.0f);
+                    shaded.viewPosition = cy::Vec3f(uniforms.mv * cy::Vec4f(vertex.position, 1.0f));
+                    shaded.viewNormal = (uniforms.mvNormal * vertex.normal).GetNormalized();
+                    shaded.uv = vertex.uv;
+                }
+            });
+
+            // Clip against the near plane, set up edge functions, and bin each triangle into the tiles its bounding box touches
+            for (std::vector<RasterTriangle>& triangles : _chunkTriangles) { triangles.clear(); }
+            for (std::vector<uint32_t>& bin : _chunkBins) { bin.clear(); }
+            parallelFor(triangleCount, _numThreads, [&](size_t begin, size_t end, unsigned int chunk)
+            {
+                size_t draw = std::upper_bound(drawTriangleEnd.begin(), drawTriangleEnd.end(), begin) - drawTriangleEnd.begin();
+                for (size_t triangle = begin; triangle < end; triangle++)
+                {
+                    while (triangle >= drawTriangleEnd[draw]) { draw++; }
+                    size_t drawTriangle = triangle - (draw > 0 ? drawTriangleEnd[draw - 1] : 0);
+                    const ShadedVertex* corners[3];
+                    for (int corner = 0; corner < 3; corner++) { corners[corner] = &_shadedVertices[indexAt(meshData, draws[draw].firstIndex + drawTriangle*3 + corner)]; }
+                    setupTriangle(corners, draws[draw].material, chunk);
+                }
+            });
+
+            // Every tile belongs to one thread, so its pixels and depth values need no synchronization
+            std::atomic<unsigned int> nextTile{ 0 };
+            unsigned int tileCount = _tilesX*_tilesY;
+            parallelFor(std::min(tileCount, _numThreads), _numThreads, [&](size_t, size_t, unsigned int)
+            {
+                for (unsigned int tile = nextTile++; tile < tileCount; tile = nextTile++) { rasterizeTile(tile, uniforms); }
+            }, 1);
+        }
+
+        /* Returns the lodepng error code, 0 on success */
+        unsigned int WritePng(const std::string& filePath) const { return lodepng::encode(filePath, _color, _width, _height); }
+
+        const std::vector<unsigned char>& Color() const { return _color; }
+        unsigned int Width() const { return _width; }
+        unsigned int Height() const { return _height; }
+        unsigned int ThreadCount() const { return _numThreads; }
+
+    private:
+        /* Vertex shader outputs */
+        struct ShadedVertex
+        {
+            cy::Vec4f clip;
+            cy::Vec3f viewPosition;
+            cy::Vec3f viewNormal;
+            cy::Vec2f uv;
+        };
+
+        /* Screen space triangle with edge functions E(x, y) = a*x + b*y + c that are positive inside */
+        struct RasterTriangle
+        {
+            float edgeA[3];
+            float edgeB[3];
+            float edgeC[3];
+            bool edgeTopLeft[3];
+            float inverseArea;
+            float depth0;           // depth at vertex 0 and its change along the barycentrics of vertices 1 and 2
+            float depthDelta1;
+            float depthDelta2;
+            float inverseW[3];
+            cy::Vec3f viewPosition[3];
+            cy::Vec3f viewNormal[3];
+            cy::Vec2f uv[3];
+            float uvArea;           // uv area covered by one pixel, for the mip level
+            const RasterMaterial* material;
+            int minX, minY, maxX, maxY;
+        };
+
+#ifdef SOFTWARE_RASTERIZER_SSE2
+        struct Float4
+        {
+            __m128 lanes;
+
+            Float4() = default;
+            explicit Float4(float value) : lanes(_mm_set1_ps(value)) { }
+            Float4(float a, float b, float c, float d) : lanes(_mm_setr_ps(a, b, c, d)) { }
+            Float4(__m128 value) : lanes(value) { }
+            static Float4 Load(const float* values) { return Float4(_mm_loadu_ps(values)); }
+            Float4 operator+(const Float4& other) const { return Float4(_mm_add_ps(lanes, other.lanes)); }
+            Float4 operator*(const Float4& other) const { return Float4(_mm_mul_ps(lanes, other.lanes)); }
+            int GreaterEqualMask(const Float4& other) const { return _mm_movemask_ps(_mm_cmpge_ps(lanes, other.lanes)); }
+            int GreaterMask(const Float4& other) const { return _mm_movemask_ps(_mm_cmpgt_ps(lanes, other.lanes)); }
+            int LessMask(const Float4& other) const { return _mm_movemask_ps(_mm_cmplt_ps(lanes, other.lanes)); }
+            void Store(float* values) const { _mm_storeu_ps(values, lanes); }
+        };
+#else
+        struct Float4
+        {
+            float lanes[4];
+
+            Float4() = default;
+            explicit Float4(float value) : lanes{ value, value, value, value } { }
+            Float4(float a, float b, float c, float d) : lanes{ a, b, c, d } { }
+            static Float4 Load(const float* values) { return Float4(values[0], values[1], values[2], values[3]); }
+            Float4 operator+(const Float4& other) const { return Float4(lanes[0] + other.lanes[0], lanes[1] + other.lanes[1], lanes[2] + other.lanes[2], lanes[3] + other.lanes[3]); }
+            Float4 operator*(const Float4& other) const { return Float4(lanes[0]*other.lanes[0], lanes[1]*other.lanes[1], lanes[2]*other.lanes[2], lanes[3]*other.lanes[3]); }
+            int GreaterEqualMask(const Float4& other) const { int mask = 0; for (int i = 0; i < 4; i++) { mask |= (lanes[i] >= other.lanes[i]) << i; } return mask; }
+            int GreaterMask(const Float4& other) const { int mask = 0; for (int i = 0; i < 4; i++) { mask |= (lanes[i] > other.lanes[i]) << i; } return mask; }
+            int LessMask(const Float4& other) const { int mask = 0; for (int i = 0; i < 4; i++) { mask |= (lanes[i] < other.lanes[i]) << i; } return mask; }
+            void Store(float* values) const { for (int i = 0; i < 4; i++) { values[i] = lanes[i]; } }
+        };
+#endif
+
+        unsigned int _width = 0;
+        unsigned int _height = 0;
+        unsigned int _numThreads = 1;
+        unsigned int _tilesX = 0;
+        unsigned int _tilesY = 0;
+        std::vector<unsigned char> _color;
+        std::vector<float> _depth;  // tile by tile, TILE_SIZE*TILE_SIZE values per tile
+        std::vector<ShadedVertex> _shadedVertices;
+        std::vector<std::vector<RasterTriangle>> _chunkTriangles;
+        std::vector<std::vector<uint32_t>> _chunkBins;  // triangles of each chunk touching each tile, in draw order
+        std::unique_ptr<ThreadPool> _pool;  // kept across frames so no pass starts threads of its own
+
+        /* Runs func(begin, end, chunk) on up to numThreads chunks of at least minChunk items */
+        template <typename FUNC>
+        void parallelFor(size_t count, unsigned int numThreads, FUNC func, size_t minChunk = 1024)
+        {
+            size_t chunkCount = std::min<size_t>(numThreads, (count + minChunk - 1) / minChunk);
+            if (chunkCount <= 1 || !_pool) { func(size_t(0), count, 0u); return; }
+            _pool->ParallelFor(chunkCount, [&](size_t chunk) { func(count*chunk/chunkCount, count*(chunk + 1)/chunkCount, static_cast<unsigned int>(chunk)); });
+        }
+
+        static size_t indexAt(const MeshData& meshData, size_t i)
+        {
+            if (meshData.indexSize == 2) { return static_cast<const uint16_t*>(meshData.indices)[i]; }
+            return static_cast<const uint32_t*>(meshData.indices)[i];
+        }
+
+        static unsigned char toByte(float value) { return static_cast<unsigned char>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f)); }
+
+        static ShadedVertex lerp(const ShadedVertex& a, const ShadedVertex& b, float t)
+        {
+            ShadedVertex result;
+            result.clip = a.clip + (b.clip - a.clip)*t;
+            result.viewPosition = a.viewPosition + (b.viewPosition - a.viewPosition)*t;
+            result.viewNormal = a.viewNormal + (b.viewNormal - a.viewNormal)*t;
+            result.uv = a.uv + (b.uv - a.uv)*t;
+            return result;
+        }
+
+        /* Clip one triangle against the near plane z = -w, which leaves at most a quad, then set up and bin its triangles */
+        void setupTriangle(const ShadedVertex* const corners[3], const RasterMaterial* material, unsigned int chunk)
+        {
+            ShadedVertex polygon[4];
+            int polygonSize = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                const ShadedVertex& current = *corners[i];
+                const ShadedVertex& next = *corners[(i + 1) % 3];
+                float currentDistance = current.clip.z + current.clip.w;
+                float nextDistance = next.clip.z + next.clip.w;
+                if (currentDistance >= 0.0f) { polygon[polygonSize++] = current; }
+                if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f)) { polygon[polygonSize++] = lerp(current, next, currentDistance / (currentDistance - nextDistance)); }
+            }
+            for (int i = 1; i + 1 < polygonSize; i++)
+            {
+                const ShadedVertex* triangle[3] = { &polygon[0], &polygon[i], &polygon[i + 1] };
+                setupClippedTriangle(triangle, material, chunk);
+            }
+        }
+
+        void setupClippedTriangle(const ShadedVertex* vertices[3], const RasterMaterial* material, unsigned int chunk)
+        {
+            // Viewport transform with the first row at the top of the image
+            float x[3], y[3], z[3], inverseW[3];
+            for (int i = 0; i < 3; i++)
+            {
+                inverseW[i] = 1.0f / vertices[i]->clip.w;
+                x[i] = (vertices[i]->clip.x*inverseW[i]*0.5f + 0.5f) * _width;
+                y[i] = (0.5f - vertices[i]->clip.y*inverseW[i]*0.5f) * _height;
+                z[i] = vertices[i]->clip.z*inverseW[i]*0.5f + 0.5f;
+            }
+
+            // Faces are not culled, so clockwise triangles are flipped to make the edge functions positive inside
+            float area = (x[1] - x[0])*(y[2] - y[0]) - (x[2] - x[0])*(y[1] - y[0]);
+            if (!(std::abs(area) > 0.0f)) { return; }
+            int order[3] = { 0, 1, 2 };
+            if (area < 0.0f) { std::swap(order[1], order[2]); area = -area; }
+
+            RasterTriangle triangle;
+            float minX = _width, minY = _height, maxX = 0.0f, maxY = 0.0f;
+            for (int i = 0; i < 3; i++)
+            {
+                int v = order[i];
+                minX = std::min(minX, x[v]); maxX = std::max(maxX, x[v]);
+                minY = std::min(minY, y[v]); maxY = std::max(maxY, y[v]);
+                triangle.inverseW[i] = inverseW[v];
+                triangle.viewPosition[i] = vertices[v]->viewPosition;
+                triangle.viewNormal[i] = vertices[v]->viewNormal;
+                triangle.uv[i] = vertices[v]->uv;
+            }
+            // Pixel centers sit at half integers. Vertices just past the near plane project far outside the range of int, so the bounds are
+            // clamped in float first, to one pixel past the viewport so triangles entirely outside it still end up empty.
+            triangle.minX = static_cast<int>(std::clamp(std::floor(minX - 0.5f), 0.0f, static_cast<float>(_width)));
+            triangle.minY = static_cast<int>(std::clamp(std::floor(minY - 0.5f), 0.0f, static_cast<float>(_height)));
+            triangle.maxX = static_cast<int>(std::clamp(std::ceil(maxX - 0.5f), -1.0f, static_cast<float>(_width) - 1.0f));
+            triangle.maxY = static_cast<int>(std::clamp(std::ceil(maxY - 0.5f), -1.0f, static_cast<float>(_height) - 1.0f));
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) { return; }
+
+            // Edge i is opposite vertex i, so E_i / area is the barycentric coordinate of vertex i.
+            // Pixels exactly on an edge belong to the triangle that has it as a top or left edge.
+            for (int i = 0; i < 3; i++)
+            {
+                int j = order[(i + 1) % 3];
+                int k = order[(i + 2) % 3];
+                triangle.edgeA[i] = y[j] - y[k];
+                triangle.edgeB[i] = x[k] - x[j];
+                triangle.edgeC[i] = x[j]*y[k] - x[k]*y[j];
+                triangle.edgeTopLeft[i] = triangle.edgeA[i] > 0.0f || (triangle.edgeA[i] == 0.0f && triangle.edgeB[i] > 0.0f);
+            }
+            triangle.inverseArea = 1.0f / area;
+            triangle.depth0 = z[order[0]];
+            triangle.depthDelta1 = z[order[1]] - z[order[0]];
+            triangle.depthDelta2 = z[order[2]] - z[order[0]];
+            cy::Vec2f uvEdge1 = triangle.uv[1] - triangle.uv[0];
+            cy::Vec2f uvEdge2 = triangle.uv[2] - triangle.uv[0];
+            triangle.uvArea = std::abs(uvEdge1.x*uvEdge2.y - uvEdge2.x*uvEdge1.y) / area;
+            triangle.material = material;
+
+            std::vector<RasterTriangle>& triangles = _chunkTriangles[chunk];
+            uint32_t triangleIndex = static_cast<uint32_t>(triangles.size());
+            triangles.push_back(triangle);
+            size_t tileCount = static_cast<size_t>(_tilesX)*_tilesY;
+            for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / static_cast<int>(TILE_SIZE); tileY++)
+            {
+                for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / static_cast<int>(TILE_SIZE); tileX++)
+                {
+                    _chunkBins[chunk*tileCount + tileY*_tilesX + tileX].push_back(triangleIndex);
+                }
+            }
+        }
+
+        void rasterizeTile(unsigned int tile, const RasterUniforms& uniforms)
+        {
+            int tileX0 = static_cast<int>((tile % _tilesX) * TILE_SIZE);
+            int tileY0 = static_cast<int>((tile / _tilesX) * TILE_SIZE);
+            float* tileDepth = &_depth[static_cast<size_t>(tile)*TILE_SIZE*TILE_SIZE];
+            size_t tileCount = static_cast<size_t>(_tilesX)*_tilesY;
+            const Float4 laneOffsets(0.5f, 1.5f, 2.5f, 3.5f);
+            const Float4 zero(0.0f);
+
+            // Chunks hold consecutive triangles, so visiting them in order keeps the draw order
+            for (unsigned int chunk = 0; chunk < _numThreads; chunk++)
+            {
+                const std::vector<RasterTriangle>& triangles = _chunkTriangles[chunk];
+                for (uint32_t triangleIndex : _chunkBins[chunk*tileCount + tile])
+                {
+                    const RasterTriangle& triangle = triangles[triangleIndex];
+                    int minX = std::max(triangle.minX, tileX0) & ~3;
+                    int maxX = std::min(triangle.maxX, tileX0 + static_cast<int>(TILE_SIZE) - 1);
+                    int minY = std::max(triangle.minY, tileY0);
+                    int maxY = std::min(triangle.maxY, tileY0 + static_cast<int>(TILE_SIZE) - 1);
+                    const RasterMaterial& material = *triangle.material;
+                    int levelKd = material.mapKd ? material.mapKd->LevelFor(triangle.uvArea) : 0;
+                    int levelKs = material.mapKs ? material.mapKs->LevelFor(triangle.uvArea) : 0;
+                    int levelKa = material.mapKa ? material.mapKa->LevelFor(triangle.uvArea) : 0;
+                    Float4 edgeA[3] = { Float4(triangle.edgeA[0]), Float4(triangle.edgeA[1]), Float4(triangle.edgeA[2]) };
+                    Float4 inverseArea(triangle.inverseArea);
+                    Float4 depth0(triangle.depth0);
+                    Float4 depthDelta1(triangle.depthDelta1);
+                    Float4 depthDelta2(triangle.depthDelta2);
+
+                    for (int pixelY = minY; pixelY <= maxY; pixelY++)
+                    {
+                        float centerY = pixelY + 0.5f;
+                        Float4 rowEdge[3];
+                        for (int i = 0; i < 3; i++) { rowEdge[i] = Float4(triangle.edgeB[i]*centerY + triangle.edgeC[i]); }
+                        float* depthRow = tileDepth + (pixelY - tileY0)*TILE_SIZE - tileX0;
+
+                        for (int pixelX = minX; pixelX <= maxX; pixelX += 4)
+                        {
+                            Float4 centerX = Float4(static_cast<float>(pixelX)) + laneOffsets;
+                            Float4 edges[3];
+                            int covered = 0xF;
+                            for (int i = 0; i < 3; i++)
+                            {
+                                edges[i] = edgeA[i]*centerX + rowEdge[i];
+                                covered &= triangle.edgeTopLeft[i] ? edges[i].GreaterEqualMask(zero) : edges[i].GreaterMask(zero);
+                            }
+                            if (covered == 0) { continue; }
+
+                            // Depth is affine in screen space, so it is interpolated with the screen space barycentrics
+                            Float4 barycentric1 = edges[1]*inverseArea;
+                            Float4 barycentric2 = edges[2]*inverseArea;
+                            Float4 depth = depth0 + depthDelta1*barycentric1 + depthDelta2*barycentric2;
+                            covered &= depth.LessMask(Float4::Load(depthRow + pixelX));
+                            if (covered == 0) { continue; }
+
+                            float depthLanes[4], barycentric1Lanes[4], barycentric2Lanes[4];
+                            depth.Store(depthLanes);
+                            barycentric1.Store(barycentric1Lanes);
+                            barycentric2.Store(barycentric2Lanes);
+                            for (int lane = 0; lane < 4; lane++)
+                            {
+                                if (!(covered & (1 << lane)) || pixelX + lane >= static_cast<int>(_width)) { continue; }
+                                depthRow[pixelX + lane] = depthLanes[lane];
+                                cy::Vec3f color = shade(triangle, barycentric1Lanes[lane], barycentric2Lanes[lane], uniforms, material, levelKd, levelKs, levelKa);
+                                unsigned char* pixel = &_color[(static_cast<size_t>(pixelY)*_width + pixelX + lane)*4];
+                                pixel[0] = toByte(color.x);
+                                pixel[1] = toByte(color.y);
+                                pixel[2] = toByte(color.z);
+                                pixel[3] = 255;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        /* fragShader.frag with perspective correct interpolation of its inputs */
+        static cy::Vec3f shade(const RasterTriangle& triangle, float barycentric1, float barycentric2, const RasterUniforms& uniforms, const RasterMaterial& material,
+                               int levelKd, int levelKs, int levelKa)
+        {
+            float weight0 = (1.0f - barycentric1 - barycentric2)*triangle.inverseW[0];
+            float weight1 = barycentric1*triangle.inverseW[1];
+            float weight2 = barycentric2*triangle.inverseW[2];
+            float inverseWeightSum = 1.0f / (weight0 + weight1 + weight2);
+            weight0 *= inverseWeightSum;
+            weight1 *= inverseWeightSum;
+            weight2 *= inverseWeightSum;
+            cy::Vec3f position = triangle.viewPosition[0]*weight0 + triangle.viewPosition[1]*weight1 + triangle.viewPosition[2]*weight2;
+            cy::Vec3f normal = (triangle.viewNormal[0]*weight0 + triangle.viewNormal[1]*weight1 + triangle.viewNormal[2]*weight2).GetNormalized();
+            cy::Vec2f uv = triangle.uv[0]*weight0 + triangle.uv[1]*weight1 + triangle.uv[2]*weight2;
+
+            cy::Vec3f Kd = material.mapKd ? material.mapKd->Sample(uv, levelKd) : material.Kd;
+            cy::Vec3f Ks = material.mapKs ? material.mapKs->Sample(uv, levelKs) : material.Ks;
+            cy::Vec3f Ka = material.mapKa ? material.mapKa->Sample(uv, levelKa) : material.Ka;
+
+            cy::Vec3f lightDir = (uniforms.lightPosition - position).GetNormalized();
+            cy::Vec3f viewDirection = (-position).GetNormalized();
+            cy::Vec3f halfVector = (viewDirection + lightDir).GetNormalized();
+
+            float geometryTerm = std::max(lightDir.Dot(normal), 0.0f);
+            float specularTerm = std::max(halfVector.Dot(normal), 0.0f);
+
+            cy::Vec3f litColorDirect(0, 0, 0);
+            if (geometryTerm > 0.0f)
+            {
+                litColorDirect = uniforms.lightIntensity * (geometryTerm*Kd + Ks*std::pow(specularTerm, material.Ns));
+            }
+            cy::Vec3f litColorIndirect = uniforms.lightAmbientIntensity * Ka;
+            return litColorDirect + litColorIndirect;
+        }
+};
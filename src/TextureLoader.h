@@ -0,0 +1,152 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lodepng.h"
+#include "ThreadPool.h"
+
+/* RGBA8 pixels of a png, or the lodepng error code if it could not be decoded */
+struct DecodedTexture
+{
+    std::vector<unsigned char> rgba;
+    unsigned width = 0;
+    unsigned height = 0;
+    unsigned error = 0;
+    double decodeSeconds = 0.0;
+    std::chrono::steady_clock::time_point decodeStart;
+    std::thread::id decodeThread;  // pool thread that decoded it, for profiling
+};
+
+/* Decodes png textures on a thread pool. Every file is decoded once however many materials or requests name it. */
+class TextureLoader {
+    public:
+        /* numThreads of 0 uses all hardware threads */
+        explicit TextureLoader(unsigned int numThreads = 0) : _pool(numThreads) { }
+
+        /* Start decoding every texture the material libraries of an obj file name, while the caller parses the obj itself.
+           Only the lines before the first face are searched for mtllib, textures of later libraries are decoded when requested. */
+        void PrefetchMaterialTextures(const std::filesystem::path& objFilePath)
+        {
+            _pool.Submit([this, objFilePath]()
+            {
+                for (const std::filesystem::path& texturePath : ScanMaterialTextures(objFilePath)) { Request(texturePath); }
+            });
+        }
+
+        /* Start decoding a texture unless it was requested before */
+        void Request(const std::filesystem::path& texturePath)
+        {
+            std::string key = Key(texturePath);
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_textures.count(key) > 0) { return; }
+            _textures.emplace(key, _pool.Submit([key]() { return decode(key); }).share());
+        }
+
+        /* Wait for a texture to be decoded, requesting it first if needed. The reference stays valid until Release. */
+        const DecodedTexture& Get(const std::filesystem::path& texturePath)
+        {
+            Request(texturePath);
+            std::shared_future<DecodedTexture> texture;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                texture = _textures.at(Key(texturePath));
+            }
+            return texture.get();
+        }
+
+        /* Number of textures requested so far and their summed decode time, waiting for any still decoding */
+        size_t TextureCount(double* decodeSeconds = nullptr)
+        {
+            std::vector<std::shared_future<DecodedTexture>> textures = requestedTextures();
+            if (decodeSeconds)
+            {
+                *decodeSeconds = 0.0;
+                for (const std::shared_future<DecodedTexture>& texture : textures) { *decodeSeconds += texture.get().decodeSeconds; }
+            }
+            return textures.size();
+        }
+
+        unsigned int ThreadCount() const { return _pool.ThreadCount(); }
+
+        /* Free the decoded pixels, for example once they are uploaded */
+        void Release()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _textures.clear();
+        }
+
+        /* Paths naming the same file through different spellings such as "a/./b.png" and "a/b.png" share one key */
+        static std::string Key(const std::filesystem::path& texturePath) { return texturePath.lexically_normal().generic_string(); }
+
+        /* map_Ka, map_Kd, and map_Ks textures of the mtllib files named before the first face of an obj file, relative to the obj file like the mesh loader resolves them */
+        static std::vector<std::filesystem::path> ScanMaterialTextures(const std::filesystem::path& objFilePath)
+        {
+            std::vector<std::filesystem::path> texturePaths;
+            std::ifstream objFile(objFilePath);
+            std::string line;
+            while (std::getline(objFile, line))
+            {
+                std::string command, argument;
+                if (!splitCommand(line, command, argument)) { continue; }
+                if (command == "f" || command == "usemtl") { break; }
+                if (command != "mtllib") { continue; }
+
+                std::ifstream mtlFile(objFilePath.parent_path() / argument);
+                std::string mtlLine;
+                while (std::getline(mtlFile, mtlLine))
+                {
+                    std::string mtlCommand, textureName;
+                    if (splitCommand(mtlLine, mtlCommand, textureName) && !textureName.empty() && (mtlCommand == "map_Ka" || mtlCommand == "map_Kd" || mtlCommand == "map_Ks"))
+                    {
+                        texturePaths.push_back(objFilePath.parent_path() / textureName);
+                    }
+                }
+            }
+            return texturePaths;
+        }
+
+    private:
+        std::mutex _mutex;
+        std::map<std::string, std::shared_future<DecodedTexture>> _textures;
+        ThreadPool _pool;  // declared last so its threads finish before the textures they fill are destroyed
+
+        /* Futures are waited on outside the lock, a prefetch task may need it to request the textures being waited for */
+        std::vector<std::shared_future<DecodedTexture>> requestedTextures()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::vector<std::shared_future<DecodedTexture>> textures;
+            for (auto& texture : _textures) { textures.push_back(texture.second); }
+            return textures;
+        }
+
+        static DecodedTexture decode(const std::string& texturePath)
+        {
+            DecodedTexture texture;
+            texture.decodeStart = std::chrono::steady_clock::now();
+            texture.decodeThread = std::this_thread::get_id();
+            texture.error = lodepng::decode(texture.rgba, texture.width, texture.height, texturePath);
+            auto end = std::chrono::steady_clock::now();
+            texture.decodeSeconds = std::chrono::duration<double>(end - texture.decodeStart).count();
+            return texture;
+        }
+
+        /* Split a line into its first word and the rest with surrounding white space removed, false for blank lines and comments */
+        static bool splitCommand(const std::string& line, std::string& command, std::string& argument)
+        {
+            std::istringstream words(line);
+            if (!(words >> command) || command[0] == '#') { return false; }
+            std::getline(words, argument);
+            size_t first = argument.find_first_not_of(" \t\r");
+            size_t last = argument.find_last_not_of(" \t\r");
+            argument = first == std::string::npos ? std::string() : argument.substr(first, last - first + 1);
+            return true;
+        }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Fixed set of worker threads running submitted tasks in submission order */
+class ThreadPool {
+    public:
+        /* numThreads of 0 uses all hardware threads */
+        explicit ThreadPool(unsigned int numThreads = 0)
+        {
+            if (numThreads == 0) { numThreads = std::max(1u, std::thread::hardware_concurrency()); }
+            for (unsigned int t = 0; t < numThreads; t++) { _threads.emplace_back([this]() { workerLoop(); }); }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /* Finishes the queued tasks before returning */
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _wake.notify_all();
+            for (std::thread& thread : _threads) { thread.join(); }
+        }
+
+        template <typename FUNC>
+        auto Submit(FUNC func) -> std::future<decltype(func())>
+        {
+            auto task = std::make_shared<std::packaged_task<decltype(func())()>>(std::move(func));
+            std::future<decltype(func())> result = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _tasks.emplace_back([task]() { (*task)(); });
+            }
+            _wake.notify_one();
+            return result;
+        }
+
+        /* Run func(chunk) for every chunk in [0, chunkCount) on the calling thread and the idle pool threads and return once all are done.
+           The calling thread takes chunks itself and only waits for chunks already running, so it is safe to call from inside a pool task. */
+        template <typename FUNC>
+        void ParallelFor(size_t chunkCount, FUNC func)
+        {
+            if (chunkCount == 0) { return; }
+            auto shared = std::make_shared<ParallelForState>();
+            shared->chunkCount = chunkCount;
+            shared->run = [&func](size_t chunk) { func(chunk); };
+            size_t helperCount = std::min<size_t>(chunkCount - 1, _threads.size());
+            if (helperCount > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    for (size_t helper = 0; helper < helperCount; helper++) { _tasks.emplace_back([shared]() { runChunks(*shared); }); }
+                }
+                if (helperCount == 1) { _wake.notify_one(); }
+                else { _wake.notify_all(); }
+            }
+            runChunks(*shared);
+            std::unique_lock<std::mutex> lock(shared->mutex);
+            shared->allDone.wait(lock, [&]() { return shared->finishedCount == chunkCount; });
+        }
+
+        unsigned int ThreadCount() const { return static_cast<unsigned int>(_threads.size()); }
+
+    private:
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        bool _stopping = false;
+
+        /* Helpers that start after every chunk was taken find nothing to run, so run is never called once ParallelFor returned */
+        struct ParallelForState
+        {
+            std::atomic<size_t> nextChunk{ 0 };
+            size_t chunkCount = 0;
+            size_t finishedCount = 0;
+            std::function<void(size_t)> run;
+            std::mutex mutex;
+            std::condition_variable allDone;
+        };
+
+        static void runChunks(ParallelForState& state)
+        {
+            size_t finished = 0;
+            for (size_t chunk = state.nextChunk++; chunk < state.chunkCount; chunk = state.nextChunk++)
+            {
+                state.run(chunk);
+                finished++;
+            }
+            if (finished == 0) { return; }
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.finishedCount += finished;
+            if (state.finishedCount == state.chunkCount) { state.allDone.notify_all(); }
+        }
+
+        void workerLoop()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _wake.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+                    if (_tasks.empty()) { return; }
+                    task = std::move(_tasks.front());
+                    _tasks.pop_front();
+                }
+                task();
+            }
+        }
+};
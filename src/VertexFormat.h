@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "cyVector.h"
+#include "MeshData.h"
+
+/* Layouts the vertex stream can be uploaded in. The compact layouts trade precision for memory and upload bandwidth. */
+enum class VertexFormat { Float32, Compact16, Compact8 };
+
+/* Positions as 16-bit fractions of the bounding box, a 2x16-bit octahedral normal, and uvs as 16-bit fractions of the uv bounds */
+struct CompactVertex16
+{
+    uint16_t position[3];
+    uint16_t padding;
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+/* Same as CompactVertex16 with a 2x8-bit octahedral normal */
+struct CompactVertex8
+{
+    uint16_t position[3];
+    int8_t normal[2];
+    uint16_t uv[2];
+};
+
+/* Uniform values vertShader.vert needs to decode a vertex stream, the identity for VertexFormat::Float32 */
+struct VertexDecode
+{
+    cy::Vec3f positionOffset = cy::Vec3f(0, 0, 0);
+    cy::Vec3f positionScale = cy::Vec3f(1, 1, 1);
+    cy::Vec2f uvOffset = cy::Vec2f(0, 0);
+    cy::Vec2f uvScale = cy::Vec2f(1, 1);
+    bool octahedralNormals = false;
+};
+
+/* Largest difference between decoded and original vertices */
+struct QuantizationError
+{
+    float position = 0.0f;       // distance in model units
+    float normalDegrees = 0.0f;  // angle between the normalized original and the decoded normal
+    float uv = 0.0f;             // largest uv component difference
+};
+
+/* Encodes MeshData vertices into a VertexFormat stream and decodes them again on the CPU the same way vertShader.vert does */
+class VertexQuantizer {
+    public:
+        static const char* Name(VertexFormat format)
+        {
+            switch (format)
+            {
+                case VertexFormat::Compact16: return "compact16";
+                case VertexFormat::Compact8: return "compact8";
+                default: return "float";
+            }
+        }
+
+        static bool Parse(const std::string& name, VertexFormat& format)
+        {
+            for (VertexFormat candidate : { VertexFormat::Float32, VertexFormat::Compact16, VertexFormat::Compact8 })
+            {
+                if (name == Name(candidate)) { format = candidate; return true; }
+            }
+            return false;
+        }
+
+        static size_t Stride(VertexFormat format)
+        {
+            switch (format)
+            {
+                case VertexFormat::Compact16: return sizeof(CompactVertex16);
+                case VertexFormat::Compact8: return sizeof(CompactVertex8);
+                default: return sizeof(MeshVertex);
+            }
+        }
+
+        /* Fill stream with the vertices of meshData in the given format and return how to decode them */
+        static VertexDecode Encode(const MeshData& meshData, VertexFormat format, std::vector<unsigned char>& stream)
+        {
+            VertexDecode decode;
+            stream.resize(meshData.vertexCount*Stride(format));
+            if (format == VertexFormat::Float32)
+            {
+                if (meshData.vertexCount > 0) { memcpy(stream.data(), meshData.vertices, stream.size()); }
+                return decode;
+            }
+
+            // Positions are quantized inside the bounding box, uvs inside the uv bounds so tiled uvs outside [0, 1] keep working
+            cy::Vec2f uvMin(0, 0);
+            cy::Vec2f uvMax(0, 0);
+            if (meshData.vertexCount > 0) { uvMin = uvMax = meshData.vertices[0].uv; }
+            for (size_t i = 0; i < meshData.vertexCount; i++)
+            {
+                for (int axis = 0; axis < 2; axis++)
+                {
+                    uvMin[axis] = std::min(uvMin[axis], meshData.vertices[i].uv[axis]);
+                    uvMax[axis] = std::max(uvMax[axis], meshData.vertices[i].uv[axis]);
+                }
+            }
+            decode.positionOffset = meshData.boundMin;
+            decode.positionScale = meshData.boundMax - meshData.boundMin;
+            decode.uvOffset = uvMin;
+            decode.uvScale = uvMax - uvMin;
+            decode.octahedralNormals = true;
+
+            int normalBits = format == VertexFormat::Compact16 ? 16 : 8;
+            for (size_t i = 0; i < meshData.vertexCount; i++)
+            {
+                const MeshVertex& vertex = meshData.vertices[i];
+                uint16_t position[3];
+                uint16_t uv[2];
+                int16_t normal[2];
+                for (int axis = 0; axis < 3; axis++) { position[axis] = quantizeUnorm16(vertex.position[axis], decode.positionOffset[axis], decode.positionScale[axis]); }
+                for (int axis = 0; axis < 2; axis++) { uv[axis] = quantizeUnorm16(vertex.uv[axis], decode.uvOffset[axis], decode.uvScale[axis]); }
+                EncodeOctahedral(vertex.normal, normalBits, normal);
+
+                if (format == VertexFormat::Compact16)
+                {
+                    CompactVertex16 compact = {};
+                    memcpy(compact.position, position, sizeof(position));
+                    memcpy(compact.normal, normal, sizeof(normal));
+                    memcpy(compact.uv, uv, sizeof(uv));
+                    memcpy(stream.data() + i*sizeof(CompactVertex16), &compact, sizeof(CompactVertex16));
+                }
+                else
+                {
+                    CompactVertex8 compact = {};
+                    memcpy(compact.position, position, sizeof(position));
+                    compact.normal[0] = static_cast<int8_t>(normal[0]);
+                    compact.normal[1] = static_cast<int8_t>(normal[1]);
+                    memcpy(compact.uv, uv, sizeof(uv));
+                    memcpy(stream.data() + i*sizeof(CompactVertex8), &compact, sizeof(CompactVertex8));
+                }
+            }
+            return decode;
+        }
+
+        /* Decode one vertex of a stream with the GL normalized integer conversion rules */
+        static MeshVertex Decode(VertexFormat format, const unsigned char* stream, size_t vertexIndex, const VertexDecode& decode)
+        {
+            MeshVertex vertex;
+            if (format == VertexFormat::Float32)
+            {
+                memcpy(&vertex, stream + vertexIndex*sizeof(MeshVertex), sizeof(MeshVertex));
+                return vertex;
+            }
+
+            uint16_t position[3];
+            uint16_t uv[2];
+            if (format == VertexFormat::Compact16)
+            {
+                CompactVertex16 compact;
+                memcpy(&compact, stream + vertexIndex*sizeof(CompactVertex16), sizeof(CompactVertex16));
+                memcpy(position, compact.position, sizeof(position));
+                memcpy(uv, compact.uv, sizeof(uv));
+                vertex.normal = DecodeOctahedral(compact.normal[0], compact.normal[1], 16);
+            }
+            else
+            {
+                CompactVertex8 compact;
+                memcpy(&compact, stream + vertexIndex*sizeof(CompactVertex8), sizeof(CompactVertex8));
+                memcpy(position, compact.position, sizeof(position));
+                memcpy(uv, compact.uv, sizeof(uv));
+                vertex.normal = DecodeOctahedral(compact.normal[0], compact.normal[1], 8);
+            }
+            for (int axis = 0; axis < 3; axis++) { vertex.position[axis] = decode.positionOffset[axis] + (position[axis] / 65535.0f)*decode.positionScale[axis]; }
+            for (int axis = 0; axis < 2; axis++) { vertex.uv[axis] = decode.uvOffset[axis] + (uv[axis] / 65535.0f)*decode.uvScale[axis]; }
+            return vertex;
+        }
+
+        static QuantizationError MeasureError(const MeshData& meshData, VertexFormat format)
+        {
+            std::vector<unsigned char> stream;
+            VertexDecode decode = Encode(meshData, format, stream);
+            QuantizationError error;
+            for (size_t i = 0; i < meshData.vertexCount; i++)
+            {
+                const MeshVertex& original = meshData.vertices[i];
+                MeshVertex decoded = Decode(format, stream.data(), i, decode);
+                error.position = std::max(error.position, (decoded.position - original.position).Length());
+                error.uv = std::max(error.uv, (decoded.uv - original.uv).Abs().Max());
+                error.normalDegrees = std::max(error.normalDegrees, NormalErrorDegrees(original.normal, decoded.normal));
+            }
+            return error;
+        }
+
+        /* Map the unit sphere onto an octahedron and unfold it into [-1, 1]^2 (Cigolle et al. 2014).
+           Of the four neighbouring grid points the one closest to the normal is kept. A zero, NaN, or infinite normal is encoded as +z. */
+        static void EncodeOctahedral(const cy::Vec3f& normal, int bits, int16_t encoded[2])
+        {
+            float maxValue = static_cast<float>((1 << (bits - 1)) - 1);
+            float l1Norm = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+            if (!(l1Norm > 0.0f) || !std::isfinite(l1Norm)) { encoded[0] = encoded[1] = 0; return; }
+            float x = normal.x / l1Norm;
+            float y = normal.y / l1Norm;
+            if (normal.z < 0.0f)
+            {
+                float foldedX = (1.0f - std::abs(y)) * signNotZero(x);
+                float foldedY = (1.0f - std::abs(x)) * signNotZero(y);
+                x = foldedX;
+                y = foldedY;
+            }
+
+            // Scaled by the L1 norm first, so the length of large normals does not overflow
+            cy::Vec3f unitNormal = (normal / l1Norm).GetNormalized();
+            float bestDot = -2.0f;
+            for (int candidate = 0; candidate < 4; candidate++)
+            {
+                float qx = (candidate & 1) ? std::ceil(x*maxValue) : std::floor(x*maxValue);
+                float qy = (candidate & 2) ? std::ceil(y*maxValue) : std::floor(y*maxValue);
+                int16_t candidateX = static_cast<int16_t>(std::clamp(qx, -maxValue, maxValue));
+                int16_t candidateY = static_cast<int16_t>(std::clamp(qy, -maxValue, maxValue));
+                float dot = DecodeOctahedral(candidateX, candidateY, bits).Dot(unitNormal);
+                if (dot > bestDot)
+                {
+                    bestDot = dot;
+                    encoded[0] = candidateX;
+                    encoded[1] = candidateY;
+                }
+            }
+        }
+
+        static cy::Vec3f DecodeOctahedral(int16_t encodedX, int16_t encodedY, int bits)
+        {
+            float maxValue = static_cast<float>((1 << (bits - 1)) - 1);
+            float x = std::max(encodedX / maxValue, -1.0f);
+            float y = std::max(encodedY / maxValue, -1.0f);
+            cy::Vec3f normal(x, y, 1.0f - std::abs(x) - std::abs(y));
+            float fold = std::max(-normal.z, 0.0f);
+            normal.x += normal.x >= 0.0f ? -fold : fold;
+            normal.y += normal.y >= 0.0f ? -fold : fold;
+            return normal.GetNormalized();
+        }
+
+        static float NormalErrorDegrees(const cy::Vec3f& original, const cy::Vec3f& decoded)
+        {
+            float length = original.Length();
+            if (length == 0.0f) { return 0.0f; }
+            // atan2 stays accurate for tiny angles where acos of a float dot product does not
+            cy::Vec3f unitOriginal = original / length;
+            return std::atan2(unitOriginal.Cross(decoded).Length(), unitOriginal.Dot(decoded)) * (180.0f / cy::Pi<float>());
+        }
+
+    private:
+        static float signNotZero(float value) { return value >= 0.0f ? 1.0f : -1.0f; }
+
+        static uint16_t quantizeUnorm16(float value, float offset, float scale)
+        {
+            if (scale <= 0.0f) { return 0; }
+            float fraction = std::clamp((value - offset) / scale, 0.0f, 1.0f);
+            return static_cast<uint16_t>(std::lround(fraction * 65535.0f));
+        }
+};
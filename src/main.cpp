@@ -4,18 +4,46 @@
 #include <fstream>
 #include <string>
 #include <filesystem>
+#include <chrono>
+#include <map>
+#include <set>
+#include <array>
+#include <sstream>
+#include <iomanip>
+#include <memory>
 #include "cyGL.h"
 #include "cyTriMesh.h"
 #include "cyMatrix.h"
 #include "cyQuat.h"
 #include "lodepng.h"
+#include "MeshData.h"
+#include "MeshCache.h"
+#include "VertexFormat.h"
+#include "MeshBVH.h"
+#include "SoftwareRasterizer.h"
+#include "TextureLoader.h"
+#include "DrawList.h"
+#include "FrameUniforms.h"
+#include "SceneLayout.h"
+#include "FrustumCuller.h"
+#include "Profiler.h"
+#include "OrbitalObject.h"
+#include "FrameReport.h"
 
 constexpr const char* V_SHADER_PATH = "res/shaders/vertShader.vert";
 constexpr const char* F_SHADER_PATH = "res/shaders/fragShader.frag";
 
+/* Instances spanning fewer pixels on screen than LOD_SCREEN_SIZES[k] are drawn with level of detail k + 1,
+   simplified on a grid whose cells cover about LOD_PIXELS_PER_CELL pixels at that size */
+constexpr float LOD_SCREEN_SIZES[] = { 256.0f, 64.0f };
+constexpr float LOD_PIXELS_PER_CELL = 2.0f;
+
 /* Convert Degrees To Radians */
 float deg2Rad(float deg) { return deg * (cy::Pi<float>()/180.0f); }
 
+/* Milliseconds Between Two Time Points */
+double millisecondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) { return std::chrono::duration<double, std::milli>(end - start).count(); }
+
 /* GLFW user input callbacks wrapper */
 class UserIO {
     public:
@@ -23,6 +51,7 @@ class UserIO {
         inline static bool rightMouseHeld = false;
         inline static bool recompileShaders = false;
         inline static bool controlPressed = false;
+        inline static bool pickRequested = false;
         inline static double xMousePosDelta = 0.0;
         inline static double yMousePosDelta = 0.0;
         inline static double xRelativeMousePosDelta = 0.0;
@@ -66,6 +95,8 @@ class UserIO {
 
             if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) { rightMouseHeld = true; }
             else if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_RELEASE) { rightMouseHeld = false; }
+
+            if (button == GLFW_MOUSE_BUTTON_MIDDLE && action == GLFW_PRESS) { pickRequested = true; }
         }
         static void getKeyInput(GLFWwindow *window, int key, int scancode, int action, int mods)
         {
@@ -76,58 +107,391 @@ class UserIO {
         }
 };
 
-class OrbitalObject {
+/* GL_TIME_ELAPSED queries of one GPU pass reused as a ring. A result is only read once the GPU reports it available, so timing never
+   waits for the GPU, and a frame is left untimed when every query of the ring is still in flight. */
+class GPUTimer {
     public:
-        float radius = 3.0;
-        float radialSpeed = 2.0;
-        cy::Vec3f worldX = cy::Vec3f(1, 0, 0);
-        cy::Vec3f worldY = cy::Vec3f(0, 1, 0);
-        cy::Vec3f worldZ = cy::Vec3f(0, 0, 1);
-        cy::Quatf currentOrientation = cy::Quatf(1, 0, 0, 0);
-        cy::Vec3f currentPosition = cy::Vec3f(0, 0, radius);
-    
-        void update(float phiDelta, float thetaDelta, float radiusDelta)
-        {
-            cy::Vec3f thetaDirection = (currentOrientation.ToMatrix3() * worldX).GetNormalized();
-            cy::Vec3f phiDirection = worldY;
-            
-            cy::Quatf rotationTheta;
-            cy::Quatf rotationPhi;
-            rotationTheta.SetRotation(thetaDelta, thetaDirection);
-            rotationPhi.SetRotation(phiDelta, phiDirection);
-            currentOrientation = rotationPhi * rotationTheta * currentOrientation;
-            currentOrientation.Normalize();
+        static constexpr int RING_SIZE = 4;
+
+        void Initialize() { glGenQueries(RING_SIZE, _queries); }
 
-            cy::Vec3f radiusDirection = (currentOrientation.ToMatrix3() * worldZ).GetNormalized();
-            radius = cy::Max(0.0f, radialSpeed*radiusDelta + radius);
-            currentPosition = radius*radiusDirection;
+        void Begin()
+        {
+            _timing = _pending < RING_SIZE;
+            if (!_timing) { return; }
+            _issued[_write] = std::chrono::steady_clock::now();
+            glBeginQuery(GL_TIME_ELAPSED, _queries[_write]);
         }
-        cy::Matrix4f getViewMatrix()
+        void End()
         {
-            cy::Matrix4f positionTranslation = cy::Matrix4f::Translation(currentPosition);
-            cy::Matrix4f orientationRotation = currentOrientation.ToMatrix4();
-            return (positionTranslation * orientationRotation).GetInverse();
+            if (!_timing) { return; }
+            glEndQuery(GL_TIME_ELAPSED);
+            _write = (_write + 1) % RING_SIZE;
+            _pending++;
         }
-        cy::Matrix4f getModelMatrix()
+
+        /* Call result(milliseconds, issued) for every finished query in the order they were issued */
+        template <typename FUNC>
+        void Collect(FUNC result)
         {
-            cy::Matrix4f positionTranslation = cy::Matrix4f::Translation(currentPosition);
-            cy::Matrix4f orientationRotation = currentOrientation.ToMatrix4();
-            return (positionTranslation * orientationRotation);
+            while (_pending > 0)
+            {
+                GLint available = 0;
+                glGetQueryObjectiv(_queries[_read], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) { return; }
+                GLuint64 nanoseconds = 0;
+                glGetQueryObjectui64v(_queries[_read], GL_QUERY_RESULT, &nanoseconds);
+                result(nanoseconds / 1e6, _issued[_read]);
+                _read = (_read + 1) % RING_SIZE;
+                _pending--;
+            }
         }
+
+    private:
+        GLuint _queries[RING_SIZE] = {};
+        std::chrono::steady_clock::time_point _issued[RING_SIZE];
+        int _write = 0;
+        int _read = 0;
+        int _pending = 0;
+        bool _timing = false;
 };
 
 
 int main(int argc, char** argv) 
 {
     /* Parse Command Line Arguements */
-    if(argc != 2) 
+    std::filesystem::path objFilePath;
+    unsigned int loadThreads = 0;
+    bool rebuildCache = false;
+    uint64_t meshBuildOptions = 0;
+    VertexFormat vertexFormat = VertexFormat::Float32;
+    std::string headlessPngPath;
+    std::filesystem::path sceneFilePath;
+    size_t stressInstanceCount = 0;
+    bool cullInstances = true;
+    std::string traceFilePath;
+    bool printProfile = false;
+    unsigned int orbitFrameCount = 0;
+    std::string resultsFilePath;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) { loadThreads = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10)); }
+        else if (arg == "--rebuild-cache") { rebuildCache = true; }
+        else if (arg == "--optimize") { meshBuildOptions |= MESH_BUILD_OPTIMIZE_VERTEX_ORDER; }
+        else if (arg == "--vertex-format" && i + 1 < argc && VertexQuantizer::Parse(argv[i + 1], vertexFormat)) { i++; }
+        else if (arg == "--headless" && i + 1 < argc) { headlessPngPath = argv[++i]; }
+        else if (arg == "--scene" && i + 1 < argc) { sceneFilePath = argv[++i]; }
+        else if (arg == "--stress" && i + 1 < argc) { stressInstanceCount = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10)); }
+        else if (arg == "--no-cull") { cullInstances = false; }
+        else if (arg == "--trace" && i + 1 < argc) { traceFilePath = argv[++i]; }
+        else if (arg == "--profile") { printProfile = true; }
+        else if (arg == "--orbit" && i + 1 < argc) { orbitFrameCount = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10))); }
+        else if (arg == "--results" && i + 1 < argc) { resultsFilePath = argv[++i]; }
+        else if (arg[0] != '-' && objFilePath.empty()) { objFilePath = arg; }
+        else
+        {
+            std::cerr << "Unrecognized argument: " << arg << std::endl;
+            objFilePath.clear();
+            break;
+        }
+    }
+    if (objFilePath.empty()) 
     {
         std::cerr << "A single argument of a path to a obj file is expected" << std::endl;
+        std::cerr << "Usage: GraphicsProject <obj file> [--threads N] [--rebuild-cache] [--optimize] [--vertex-format float|compact16|compact8] [--headless <png file>] [--scene <layout file>] [--stress N] [--no-cull] [--profile] [--trace <json file>] [--orbit N] [--results <json file>]" << std::endl;
         return -1;
     }
-    std::filesystem::path objFilePath(argv[1]);
+
+    /* Start Decoding the Textures of the Material Libraries on the Texture Loader Threads While the Mesh Loads */
+    auto startupStart = std::chrono::steady_clock::now();
+    // Spans are only kept for the trace file, the frame statistics are measured either way
+    Profiler profiler(startupStart);
+    profiler.SetRecording(!traceFilePath.empty());
+    auto writeTrace = [&]()
+    {
+        if (traceFilePath.empty()) { return; }
+        if (profiler.EventLimitReached()) { std::cout << "Trace reached " << Profiler::MAX_EVENTS << " events, later ones were dropped" << std::endl; }
+        if (profiler.WriteChromeTrace(traceFilePath, &std::cerr)) { std::cout << "Wrote " << profiler.EventCount() << " trace events to " << traceFilePath << std::endl; }
+    };
+    TextureLoader textureLoader;
+    textureLoader.PrefetchMaterialTextures(objFilePath);
+
+    /* Load Mesh from the Binary Cache, or Parse it from File and Write the Cache */
+    MeshData meshData;
+    MeshCache meshCache;
+    std::filesystem::path meshCacheFilePath = MeshCache::PathFor(objFilePath);
+    MeshCacheKey meshCacheKey;
+    bool meshCacheKeyIsReady = MeshCache::ComputeKey(objFilePath, meshBuildOptions, meshCacheKey);
+    bool meshIsCached = false;
+    if (!rebuildCache && meshCacheKeyIsReady)
+    {
+        Profiler::Scope readCacheScope(profiler, "Read Mesh Cache", "load");
+        meshIsCached = meshCache.Load(meshCacheFilePath, meshCacheKey, meshData);
+    }
+    if (!meshIsCached)
+    {
+        cy::TriMesh mesh;
+        Profiler::Scope parseScope(profiler, "Parse OBJ", "load");
+        bool meshIsReady = mesh.LoadFromFileObj(objFilePath.string().c_str(), true, &std::cout, loadThreads);
+        parseScope.Stop();
+        if (!meshIsReady)
+        {
+            std::cerr << "Could not load mesh from obj file at path: " << objFilePath << std::endl;
+            glfwTerminate();
+            return -1;        
+        }
+        if ( !(mesh.HasNormals() && mesh.HasTextureVertices()) )
+        {
+            std::cerr << "Could find vertex normal or vertex texture uv's at: " << objFilePath << std::endl;
+            glfwTerminate();
+            return -1;        
+        }
+        if ( mesh.NM() == 0)
+        {
+            std::cout << "No .mtl file found in the same directory as " << objFilePath << ", drawing with the default material" << std::endl;
+        }
+        Profiler::Scope buildScope(profiler, "Build Mesh Data", "load");
+        bool meshDataIsReady = meshData.BuildFromTriMesh(mesh);
+        buildScope.Stop();
+        if (!meshDataIsReady)
+        {
+            std::cerr << "Could not prepare mesh for rendering, a face index may be out of range or a material or texture name too long: " << objFilePath << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        meshData.PrintIndexingStats(std::cout);
+        if (meshBuildOptions & MESH_BUILD_OPTIMIZE_VERTEX_ORDER)
+        {
+            Profiler::Scope optimizeScope(profiler, "Optimize Vertex Order", "load");
+            VertexCacheStats statsBefore = meshData.SimulateVertexCache(16);
+            meshData.OptimizeVertexOrder(16);
+            VertexCacheStats statsAfter = meshData.SimulateVertexCache(16);
+            std::cout << "Vertex cache (16 entry FIFO): ACMR " << statsBefore.acmr << " -> " << statsAfter.acmr
+                      << ", ATVR " << statsBefore.atvr << " -> " << statsAfter.atvr << std::endl;
+        }
+        Profiler::Scope writeCacheScope(profiler, "Write Mesh Cache", "load");
+        if (!meshCacheKeyIsReady || !MeshCache::Save(meshCacheFilePath, meshCacheKey, meshData))
+        {
+            std::cerr << "Could not write mesh cache at path: " << meshCacheFilePath << std::endl;
+        }
+    }
+    auto meshLoadEnd = std::chrono::steady_clock::now();
+    profiler.Record("Load Mesh", "load", startupStart, meshLoadEnd);
+
+    /* Prepare Model Matrix from Mesh Bounding Box */
+    cy::Matrix4f modelMatrix = SceneLayout::ModelMatrix(meshData.boundMin, meshData.boundMax, 0.05f);
+
+    /* Place Copies of the Mesh from a Scene Layout, on a Stress Test Grid, or a Single One at the Origin */
+    SceneLayout sceneLayout;
+    float meshWorldRadius = (meshData.boundMax - meshData.boundMin).Length()/2 * 0.05f;
+    if (!sceneFilePath.empty())
+    {
+        if (!sceneLayout.LoadFromFile(sceneFilePath, &std::cerr))
+        {
+            glfwTerminate();
+            return -1;
+        }
+    }
+    else if (stressInstanceCount > 0) { sceneLayout.BuildGrid(stressInstanceCount, 2.5f*meshWorldRadius); }
+    else { sceneLayout.instances.emplace_back(); }
+
+    /* Simplify the Mesh into Coarser Levels of Detail for Instances Far from the Camera */
+    // Every level shares the vertices of the mesh and keeps its index size, so all levels fit in one index buffer
+    std::vector<std::unique_ptr<MeshData>> simplifiedMeshes;
+    std::vector<const MeshData*> lodMeshes = { &meshData };
+    LODSelection lodSelection;
+    if (cullInstances && sceneLayout.instances.size() > 1)
+    {
+        for (float screenSize : LOD_SCREEN_SIZES)
+        {
+            auto simplifyStart = std::chrono::steady_clock::now();
+            simplifiedMeshes.push_back(std::make_unique<MeshData>());
+            simplifiedMeshes.back()->BuildSimplified(meshData, static_cast<unsigned int>(screenSize / LOD_PIXELS_PER_CELL));
+            auto simplifyEnd = std::chrono::steady_clock::now();
+            profiler.Record("Simplify Level of Detail " + std::to_string(lodMeshes.size()), "load", simplifyStart, simplifyEnd);
+            if (simplifiedMeshes.back()->indexSize != meshData.indexSize || simplifiedMeshes.back()->indexCount == 0)
+            {
+                simplifiedMeshes.pop_back();
+                break;
+            }
+            lodMeshes.push_back(simplifiedMeshes.back().get());
+            lodSelection.screenSizes.push_back(screenSize);
+            std::cout << "Level of detail " << lodMeshes.size() - 1 << " below " << screenSize << " pixels: " << lodMeshes.back()->indexCount/3 << " of " << meshData.indexCount/3
+                      << " triangles, simplified in " << millisecondsBetween(simplifyStart, simplifyEnd) << " ms" << std::endl;
+        }
+    }
+
+    /* World Space Bounds of Every Instance, Culled Against the View Frustum Each Frame */
+    CullBounds instanceBounds;
+    instanceBounds.Reserve(sceneLayout.instances.size());
+    for (const InstanceTransform& instance : sceneLayout.instances) { instanceBounds.AddTransformed(instance.Matrix() * modelMatrix, meshData.boundMin, meshData.boundMax); }
+    FrustumCuller frustumCuller;
+    // Without culling every instance stays visible at full detail
+    CullResult cullResult;
+    cullResult.levels.resize(lodSelection.LevelCount());
+    for (uint32_t instance = 0; instance < sceneLayout.instances.size(); instance++) { cullResult.levels[0].push_back(instance); }
+
+    /* Wait for the Textures */
+    // Only the time spent in the wait itself is reported, simplifying the levels of detail above overlaps with decoding
+    auto textureWaitStart = std::chrono::steady_clock::now();
+    // Texture files of every material in the order of the draw command texture slots, map_Ka falls back to the diffuse texture
+    std::vector<std::array<std::string, DrawCommand::TEXTURE_SLOTS>> materialTextureKeys(meshData.materialCount);
+    for (size_t m = 0; m < meshData.materialCount; m++)
+    {
+        const MeshMaterial& material = meshData.materials[m];
+        const char* textureNames[DrawCommand::TEXTURE_SLOTS] = { material.mapKd, material.mapKs, material.mapKa[0] != '\0' ? material.mapKa : material.mapKd };
+        for (int slot = 0; slot < DrawCommand::TEXTURE_SLOTS; slot++)
+        {
+            if (textureNames[slot][0] == '\0') { continue; }
+            std::filesystem::path textureFilePath = objFilePath.parent_path() / std::filesystem::path(textureNames[slot]);
+            materialTextureKeys[m][slot] = TextureLoader::Key(textureFilePath);
+            textureLoader.Request(textureFilePath);
+        }
+    }
+    // A texture that does not load is replaced by the constant color of its material
+    std::map<std::string, const DecodedTexture*> decodedTextures;
+    std::set<std::string> failedTextures;
+    for (size_t m = 0; m < meshData.materialCount; m++)
+    {
+        for (std::string& textureKey : materialTextureKeys[m])
+        {
+            if (textureKey.empty()) { continue; }
+            if (decodedTextures.count(textureKey) == 0 && failedTextures.count(textureKey) == 0)
+            {
+                const DecodedTexture& decodedTexture = textureLoader.Get(textureKey);
+                if (decodedTexture.error)
+                {
+                    std::cerr << "Could not load texture " << textureKey << " of material " << meshData.materials[m].name << ": " << lodepng_error_text(decodedTexture.error)
+                              << ", using the constant colors of the materials naming it instead" << std::endl;
+                    failedTextures.insert(textureKey);
+                }
+                else { decodedTextures[textureKey] = &decodedTexture; }
+            }
+            if (failedTextures.count(textureKey) > 0) { textureKey.clear(); }
+        }
+    }
+    auto textureWaitEnd = std::chrono::steady_clock::now();
+    std::vector<MaterialConstants> materialConstants = DrawList::MaterialConstantsOf(meshData, [&](size_t m, uint32_t map)
+    {
+        int slot = map == MaterialConstants::MAP_KD ? 0 : map == MaterialConstants::MAP_KS ? 1 : 2;
+        return !materialTextureKeys[m][slot].empty();
+    });
+    // Levels of detail keep the materials of the mesh, only their index ranges differ
+    std::vector<std::vector<MaterialRange>> lodMaterialRanges;
+    for (const MeshData* lodMesh : lodMeshes) { lodMaterialRanges.push_back(DrawList::MaterialRanges(*lodMesh)); }
+    double textureDecodeSeconds = 0.0;
+    size_t textureCount = textureLoader.TextureCount(&textureDecodeSeconds);
+    profiler.Record("Wait for Textures", "load", textureWaitStart, textureWaitEnd);
+    for (const auto& decodedTexture : decodedTextures)
+    {
+        auto decodeEnd = decodedTexture.second->decodeStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(decodedTexture.second->decodeSeconds));
+        profiler.Record("Decode " + decodedTexture.first, "load", decodedTexture.second->decodeStart, decodeEnd, decodedTexture.second->decodeThread);
+    }
+    std::cout << "Mesh loaded in " << millisecondsBetween(startupStart, meshLoadEnd) << " ms, " << textureCount << " textures decoded in "
+              << textureDecodeSeconds*1000.0 << " ms on " << textureLoader.ThreadCount() << " threads alongside it, waited "
+              << millisecondsBetween(textureWaitStart, textureWaitEnd) << " ms for them afterwards" << std::endl;
+
+    /* Data on Scene */
+    OrbitalObject camera;
+    OrbitalObject light;
+    light.update(0, -deg2Rad(70), 0);
+
+    float fovRadians = deg2Rad(75);
+    float zFar = 1000;
+    float zNear = 0.1f;
+
+    // Back the camera off until every instance fits in view
+    float sceneExtent = sceneLayout.Extent();
+    if (sceneExtent > 0.0f)
+    {
+        camera.radius += (sceneExtent + meshWorldRadius) / std::tan(fovRadians/2);
+        camera.update(0, 0, 0);
+        zFar = std::max(zFar, 2*(camera.radius + sceneExtent));
+    }
+
+    float lightIntensity = 0.9f;
+    float lightAmbientIntensity = 0.1f;
+
+    // Built on the first pick so loading stays as fast as before for sessions that never pick
+    MeshBVH meshBVH;
+    bool meshBVHIsReady = false;
+
+    /* Render One Frame on the CPU to a PNG Instead of Opening a Window */
+    int windowWidth = 1280;
+    int windowHeight = 960;
+    if (!headlessPngPath.empty())
+    {
+        std::map<std::string, RasterTexture> rasterTextures;
+        for (const auto& decodedTexture : decodedTextures)
+        {
+            RasterTexture& rasterTexture = rasterTextures[decodedTexture.first];
+            rasterTexture.SetImage(decodedTexture.second->rgba.data(), decodedTexture.second->width, decodedTexture.second->height);
+            rasterTexture.BuildMipmaps();
+        }
+        // Textures that did not decode are missing from rasterTextures, so their materials use the constant colors like on the GPU
+        std::vector<RasterMaterial> rasterMaterials = SoftwareRasterizer::MaterialsOf(meshData, [&](const char* textureName) -> const RasterTexture*
+        {
+            auto rasterTexture = rasterTextures.find(TextureLoader::Key(objFilePath.parent_path() / std::filesystem::path(textureName)));
+            return rasterTexture != rasterTextures.end() ? &rasterTexture->second : nullptr;
+        });
+        std::vector<std::vector<RasterDraw>> lodRasterDraws;
+        for (const std::vector<MaterialRange>& levelRanges : lodMaterialRanges) { lodRasterDraws.push_back(SoftwareRasterizer::DrawsOf(levelRanges, rasterMaterials)); }
+
+        cy::Matrix4f viewMatrix = camera.getViewMatrix();
+        float aspect = static_cast<float>(windowWidth) / static_cast<float>(windowHeight);
+        cy::Matrix4f perspectiveMatrix = cy::Matrix4f::Perspective(fovRadians, aspect, zNear, zFar);
+        RasterUniforms rasterUniforms;
+        rasterUniforms.lightPosition = cy::Vec3f( viewMatrix * cy::Vec4f(light.currentPosition, 1.0) );
+        rasterUniforms.lightIntensity = lightIntensity;
+        rasterUniforms.lightAmbientIntensity = lightAmbientIntensity;
+
+        auto cullStart = std::chrono::steady_clock::now();
+        if (cullInstances)
+        {
+            lodSelection.cameraPosition = camera.currentPosition;
+            lodSelection.pixelsPerUnit = LODSelection::PixelsPerUnit(fovRadians, windowHeight);
+            frustumCuller.Cull(instanceBounds, Frustum::FromViewProjection(perspectiveMatrix * viewMatrix), lodSelection, cullResult);
+        }
+        auto cullEnd = std::chrono::steady_clock::now();
+        profiler.Record("Cull", "cpu", cullStart, cullEnd);
+        std::cout << "Culled " << sceneLayout.instances.size() << " instances to " << cullResult.VisibleCount() << " in " << millisecondsBetween(cullStart, cullEnd) << " ms, per level of detail:";
+        for (const std::vector<uint32_t>& levelInstances : cullResult.levels) { std::cout << " " << levelInstances.size(); }
+        std::cout << std::endl;
+
+        SoftwareRasterizer rasterizer;
+        rasterizer.Resize(windowWidth, windowHeight);
+        auto renderStart = std::chrono::steady_clock::now();
+        rasterizer.Clear(0, 0, 0);
+        // The rasterizer has no instancing, each visible instance is drawn with its own model view matrix and level of detail
+        for (size_t level = 0; level < cullResult.levels.size(); level++)
+        {
+            for (uint32_t instance : cullResult.levels[level])
+            {
+                cy::Matrix4f instanceModelView = viewMatrix * sceneLayout.instances[instance].Matrix() * modelMatrix;
+                rasterUniforms.mvp = perspectiveMatrix * instanceModelView;
+                rasterUniforms.mv = instanceModelView;
+                rasterUniforms.mvNormal = cy::Matrix3f(instanceModelView).GetInverse().GetTranspose();
+                rasterizer.DrawMesh(*lodMeshes[level], lodRasterDraws[level], rasterUniforms);
+            }
+        }
+        auto renderEnd = std::chrono::steady_clock::now();
+        profiler.Record("Rasterize", "cpu", renderStart, renderEnd);
+        std::cout << "Rendered " << cullResult.VisibleCount() << " instances of " << lodRasterDraws[0].size() << " draws at " << windowWidth << "x" << windowHeight << " on " << rasterizer.ThreadCount() << " threads in "
+                  << std::chrono::duration<double, std::milli>(renderEnd - renderStart).count() << " ms" << std::endl;
+
+        unsigned pngLodeErrorHeadless = rasterizer.WritePng(headlessPngPath);
+        if (pngLodeErrorHeadless)
+        {
+            std::cerr << "Could not write headless render: " << pngLodeErrorHeadless << ": " << lodepng_error_text(pngLodeErrorHeadless) << std::endl;
+            return -1;
+        }
+        writeTrace();
+        return 0;
+    }
 
     /* Initialize a GLFW Window */
+    auto windowStart = std::chrono::steady_clock::now();
     int glfwErrorCode = glfwInit();
     if (GLFW_TRUE != glfwErrorCode)
     {
@@ -136,8 +500,8 @@ int main(int argc, char** argv)
     }
 
     /* Create a GLFW Window */
-    int windowWidth = 1280;
-    int windowHeight = 960;
+    // Runs writing results are measured without showing the window, the frames still render to its back buffer
+    if (!resultsFilePath.empty()) { glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); }
     GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, "InteractiveGraphicsProject", NULL, NULL);
     if (!window) {
         std::cerr << "Could not initialize a GLFW window" << std::endl;
@@ -153,163 +517,209 @@ int main(int argc, char** argv)
         glfwTerminate();
         return -1;
     }
+    profiler.Record("Create Window", "load", windowStart, std::chrono::steady_clock::now());
 
     /* Load Shaders */
     cy::GLSLProgram program;
+    Profiler::Scope shaderScope(profiler, "Build Shaders", "load");
     bool shaderIsReady = program.BuildFiles(V_SHADER_PATH, F_SHADER_PATH);
+    shaderScope.Stop();
     if (!shaderIsReady)
     {
         glfwTerminate();
         std::cerr << "Failed to compile shaders" << std::endl;
         return -1;          
     }
+    program.RegisterUniforms(PROGRAM_UNIFORM_NAMES, 0, &std::cerr);
+
+    /* Per-Frame Uniforms in One Uniform Buffer Shared by Every Draw */
+    // The block binding is fixed in the shaders, so the buffer stays attached across shader reloads
+    FrameUniforms frameUniforms;
+    GLuint frameUniformBuffer;
+    glGenBuffers(1, &frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    /* Parse Mesh from File and Prepare Model Matrix from Mesh Bounding Box */
-    cy::TriMesh mesh;
-    bool meshIsReady = mesh.LoadFromFileObj(objFilePath.string().c_str(), true);
-    if (!meshIsReady)
+    /* Write Mesh to GPU */
+    auto meshUploadStart = std::chrono::steady_clock::now();
+    GLuint vao;
+    GLuint vertexBuffer;
+    GLuint indexBuffer;
+    GLuint instanceBuffer;
+    GLenum indexType = meshData.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    GLuint positionLocation = 0;
+    GLuint normalLocation = 1;
+    GLuint uvLocation = 2;
+    GLuint instanceTranslationScaleLocation = 3;
+    GLuint instanceRotationLocation = 4;
+
+    // Float vertices go straight from the built mesh or the memory mapped cache to the GPU, compact formats are encoded first
+    VertexDecode vertexDecode;
+    std::vector<unsigned char> compactVertices;
+    const void* vertexStream = meshData.vertices;
+    GLsizei vertexStride = static_cast<GLsizei>(VertexQuantizer::Stride(vertexFormat));
+    if (vertexFormat != VertexFormat::Float32)
     {
-        std::cerr << "Could not load mesh from obj file at path: " << objFilePath << std::endl;
-        glfwTerminate();
-        return -1;        
+        vertexDecode = VertexQuantizer::Encode(meshData, vertexFormat, compactVertices);
+        vertexStream = compactVertices.data();
+        std::cout << "Vertex format " << VertexQuantizer::Name(vertexFormat) << ": " << vertexStride << " bytes per vertex instead of " << sizeof(MeshVertex) << std::endl;
     }
-    if ( !(mesh.HasNormals() && mesh.HasTextureVertices()) )
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, meshData.vertexCount*vertexStride, vertexStream, GL_STATIC_DRAW);
+    if (vertexFormat == VertexFormat::Float32)
     {
-        std::cerr << "Could find vertex normal or vertex texture uv's at: " << objFilePath << std::endl;
-        glfwTerminate();
-        return -1;        
+        glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, vertexStride, reinterpret_cast<void*>(offsetof(MeshVertex, position)));
+        glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, vertexStride, reinterpret_cast<void*>(offsetof(MeshVertex, normal)));
+        glVertexAttribPointer(uvLocation, 2, GL_FLOAT, GL_FALSE, vertexStride, reinterpret_cast<void*>(offsetof(MeshVertex, uv)));
     }
-    if ( mesh.NM() == 0)
+    else if (vertexFormat == VertexFormat::Compact16)
     {
-        std::cerr << "Count not find at least one .mtl file in the same directory as: " << objFilePath << std::endl;
-        glfwTerminate();
-        return -1;        
+        glVertexAttribPointer(positionLocation, 3, GL_UNSIGNED_SHORT, GL_TRUE, vertexStride, reinterpret_cast<void*>(offsetof(CompactVertex16, position)));
+        glVertexAttribPointer(normalLocation, 2, GL_SHORT, GL_TRUE, vertexStride, reinterpret_cast<void*>(offsetof(CompactVertex16, normal)));
+        glVertexAttribPointer(uvLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, vertexStride, reinterpret_cast<void*>(offsetof(CompactVertex16, uv)));
     }
-
-    mesh.ComputeBoundingBox();
-    cy::Vec3f meshCenter = (mesh.GetBoundMax() + mesh.GetBoundMin())/2;
-    cy::Matrix4f meshScale = cy::Matrix4f::Scale(cy::Vec3f(0.05f, 0.05f, 0.05f));
-    cy::Matrix4f meshRotationX = cy::Matrix4f::RotationX(deg2Rad(-90));
-    cy::Matrix4f meshRotationY = cy::Matrix4f::RotationY(deg2Rad(90));
-    cy::Matrix4f meshToOrigin = cy::Matrix4f::Translation(-meshCenter);
-    cy::Matrix4f modelMatrix = meshRotationY * meshRotationX * meshScale * meshToOrigin;
-
-    /* Load Textures */
-    std::filesystem::path diffuseTextureFilePath = objFilePath.parent_path() / std::filesystem::path(mesh.M(0).map_Kd.data);
-    std::vector<unsigned char> diffuseTextureData; 
-    unsigned diffuseTextureWidth, diffuseTextureHeight;
-    unsigned pngLodeErrorDiffuse = lodepng::decode(diffuseTextureData, diffuseTextureWidth, diffuseTextureHeight, diffuseTextureFilePath.string());
-    if(pngLodeErrorDiffuse)
+    else
     {
-        std::cerr << "Attempted to find diffuse texture at according to .mtl file: " << diffuseTextureFilePath.string() << std::endl;
-        std::cerr << "Could not load diffuse texture: " << pngLodeErrorDiffuse << ": " << lodepng_error_text(pngLodeErrorDiffuse) << std::endl;
-        glfwTerminate();
-        return -1;       
+        glVertexAttribPointer(positionLocation, 3, GL_UNSIGNED_SHORT, GL_TRUE, vertexStride, reinterpret_cast<void*>(offsetof(CompactVertex8, position)));
+        glVertexAttribPointer(normalLocation, 2, GL_BYTE, GL_TRUE, vertexStride, reinterpret_cast<void*>(offsetof(CompactVertex8, normal)));
+        glVertexAttribPointer(uvLocation, 2, GL_UNSIGNED_SHORT, GL_TRUE, vertexStride, reinterpret_cast<void*>(offsetof(CompactVertex8, uv)));
     }
-    std::filesystem::path specularTextureFilePath = objFilePath.parent_path() / std::filesystem::path(mesh.M(0).map_Ks.data);
-    std::vector<unsigned char> specularTextureData; 
-    unsigned specularTextureWidth, specularTextureHeight;
-    unsigned pngLodeErrorSpecular = lodepng::decode(specularTextureData, specularTextureWidth, specularTextureHeight, specularTextureFilePath.string());
-    if(pngLodeErrorSpecular)
+    glEnableVertexAttribArray(positionLocation);
+    glEnableVertexAttribArray(normalLocation);
+    glEnableVertexAttribArray(uvLocation);
+
+    // The levels of detail follow each other in the index buffer
+    std::vector<size_t> lodFirstIndex;
+    size_t lodIndexCount = 0;
+    for (const MeshData* lodMesh : lodMeshes)
     {
-        std::cerr << "Attempted to find specular texture at according to .mtl file: " << specularTextureFilePath.string() << std::endl;
-        std::cerr << "Could not load specular texture: " << pngLodeErrorSpecular << ": " << lodepng_error_text(pngLodeErrorSpecular) << std::endl;
-        glfwTerminate();
-        return -1;       
+        lodFirstIndex.push_back(lodIndexCount);
+        lodIndexCount += lodMesh->indexCount;
     }
-
-    /* Write Mesh to GPU */
-    std::vector<cy::Vec3f> positions;
-    std::vector<cy::Vec3f> normals;
-    std::vector<cy::Vec3f> uvs;
-
-    // For each face find the vertices, normals, and uvs and put them in lists ordered by face index
-    for (unsigned int faceIndex = 0; faceIndex < mesh.NF(); faceIndex++)
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, lodIndexCount*meshData.indexSize, nullptr, GL_STATIC_DRAW);
+    for (size_t level = 0; level < lodMeshes.size(); level++)
     {
-        cy::TriMesh::TriFace facePositions = mesh.F(faceIndex);
-        cy::TriMesh::TriFace faceNormals = mesh.FN(faceIndex);
-        cy::TriMesh::TriFace faceUvs = mesh.FT(faceIndex);
-        for (int indexOnFace = 0; indexOnFace < 3; indexOnFace++)
-        {
-            unsigned int vertexPositionIndex = facePositions.v[indexOnFace];
-            unsigned int vertexNormalIndex = faceNormals.v[indexOnFace];
-            unsigned int vertexUvIndex = faceUvs.v[indexOnFace];
-
-            positions.push_back( mesh.V(vertexPositionIndex) );
-            normals.push_back( mesh.VN(vertexNormalIndex) );
-            uvs.push_back( mesh.VT(vertexUvIndex) );
-        }    
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, lodFirstIndex[level]*meshData.indexSize, lodMeshes[level]->IndexBytes(), lodMeshes[level]->indices);
     }
 
-    GLuint vao;
-    GLuint positionBuffer;
-    GLuint normalBuffer;
-    GLuint uvBuffer;
-    GLuint positionLocation = 0;
-    GLuint normalLocation = 1;
-    GLuint uvLocation = 2;
-
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
-    
-    glGenBuffers(1, &positionBuffer); 
-    glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
-    glBufferData(GL_ARRAY_BUFFER, positions.size()*sizeof(cy::Vec3f), positions.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(positionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(cy::Vec3f), 0);
-    glEnableVertexAttribArray(positionLocation);
-
-    glGenBuffers(1, &normalBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-    glBufferData(GL_ARRAY_BUFFER, normals.size()*sizeof(cy::Vec3f), normals.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(normalLocation, 3, GL_FLOAT, GL_FALSE, sizeof(cy::Vec3f), 0);
-    glEnableVertexAttribArray(normalLocation);
-
-    glGenBuffers(1, &uvBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-    glBufferData(GL_ARRAY_BUFFER, uvs.size()*sizeof(cy::Vec3f), uvs.data(), GL_STATIC_DRAW);
-    glVertexAttribPointer(uvLocation, 3, GL_FLOAT, GL_FALSE, sizeof(cy::Vec3f), 0);
-    glEnableVertexAttribArray(uvLocation);
+    // One transform per instance, advanced once per instance instead of once per vertex.
+    // Visible instances are rewritten each frame grouped by level of detail, so each level draws a contiguous run of them.
+    GLsizei instanceCount = static_cast<GLsizei>(sceneLayout.instances.size());
+    GLsizeiptr instanceBufferBytes = sceneLayout.instances.size()*sizeof(InstanceTransform);
+    std::vector<InstanceTransform> visibleInstances;
+    visibleInstances.reserve(sceneLayout.instances.size());
+    glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, instanceBufferBytes, sceneLayout.instances.data(), cullInstances ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+    glVertexAttribPointer(instanceTranslationScaleLocation, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), reinterpret_cast<void*>(offsetof(InstanceTransform, translationScale)));
+    glVertexAttribPointer(instanceRotationLocation, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), reinterpret_cast<void*>(offsetof(InstanceTransform, rotation)));
+    glVertexAttribDivisor(instanceTranslationScaleLocation, 1);
+    glVertexAttribDivisor(instanceRotationLocation, 1);
+    glEnableVertexAttribArray(instanceTranslationScaleLocation);
+    glEnableVertexAttribArray(instanceRotationLocation);
     
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);  
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    auto meshUploadEnd = std::chrono::steady_clock::now();
+    profiler.Record("Upload Mesh", "load", meshUploadStart, meshUploadEnd);
 
-    /* Write Textures to GPU */
-    cy::GLTexture2D texDiffuse;
-    int texDiffuseUnit = 1;
-    texDiffuse.Initialize();
-    texDiffuse.SetImage<unsigned char>(&diffuseTextureData[0], 4, diffuseTextureWidth, diffuseTextureHeight);
-    texDiffuse.BuildMipmaps();
+    /* Write Textures to GPU, Once per Texture File */
+    auto textureUploadStart = std::chrono::steady_clock::now();
+    std::map<std::string, cy::GLTexture2D> gpuTextures;
+    for (const auto& decodedTexture : decodedTextures)
+    {
+        cy::GLTexture2D& gpuTexture = gpuTextures[decodedTexture.first];
+        gpuTexture.Initialize();
+        gpuTexture.SetImage<unsigned char>(decodedTexture.second->rgba.data(), 4, decodedTexture.second->width, decodedTexture.second->height);
+        gpuTexture.BuildMipmaps();
+    }
+    // The decoded pixels are no longer needed once they are on the GPU
+    decodedTextures.clear();
+    textureLoader.Release();
+    auto textureUploadEnd = std::chrono::steady_clock::now();
+    profiler.Record("Upload Textures", "load", textureUploadStart, textureUploadEnd);
 
-    cy::GLTexture2D texSpecular;
+    int texDiffuseUnit = 1;
     int texSpecularUnit = 2;
-    texSpecular.Initialize();
-    texSpecular.SetImage<unsigned char>(&specularTextureData[0], 4, specularTextureWidth, specularTextureHeight);
-    texSpecular.BuildMipmaps();
-    
-    cy::GLTexture2D texAmbient;
     int texAmbientUnit = 3;
-    texAmbient.Initialize();
-    texAmbient.SetImage<unsigned char>(&diffuseTextureData[0], 4, diffuseTextureWidth, diffuseTextureHeight);
-    texAmbient.BuildMipmaps();
-
-    /* Data on Scene */
-    OrbitalObject camera;
-    OrbitalObject light;
-    light.update(0, -deg2Rad(70), 0);
-
-    float fovRadians = deg2Rad(75);
-    float zFar = 1000;
-    float zNear = 0.1f;
-
-    float lightIntensity = 0.9f;
-    float lightAmbientIntensity = 0.1f;
+    int textureUnits[DrawCommand::TEXTURE_SLOTS] = { texDiffuseUnit, texSpecularUnit, texAmbientUnit };
+    std::cout << "Uploaded " << gpuTextures.size() << " textures in " << millisecondsBetween(textureUploadStart, textureUploadEnd)
+              << " ms, startup took " << millisecondsBetween(startupStart, textureUploadEnd) << " ms" << std::endl;
+
+    /* Write Material Constants to GPU, Indexed by the Draws */
+    GLuint materialBuffer;
+    GLuint materialBufferBinding = 0;
+    glGenBuffers(1, &materialBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, materialConstants.size()*sizeof(MaterialConstants), materialConstants.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, materialBufferBinding, materialBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    /* One Draw per Material Range of Each Level of Detail, Sorted by Program and Textures */
+    // Levels without visible instances are left out of the draw list of the frame
+    std::vector<std::vector<DrawCommand>> lodDrawCommands(lodMeshes.size());
+    for (size_t level = 0; level < lodMeshes.size(); level++)
+    {
+        for (const MaterialRange& range : lodMaterialRanges[level])
+        {
+            DrawCommand command;
+            command.program = program.GetID();
+            command.materialIndex = range.materialIndex;
+            command.firstIndex = static_cast<uint32_t>(lodFirstIndex[level] + range.firstIndex);
+            command.indexCount = range.indexCount;
+            for (int slot = 0; slot < DrawCommand::TEXTURE_SLOTS && range.materialIndex < meshData.materialCount; slot++)
+            {
+                const std::string& textureKey = materialTextureKeys[range.materialIndex][slot];
+                if (!textureKey.empty()) { command.textures[slot] = gpuTextures.at(textureKey).GetID(); }
+            }
+            lodDrawCommands[level].push_back(command);
+        }
+    }
+    DrawList drawList;
+    FrameCounters shownFrameCounters;
+    size_t shownVisibleCount = 0;
 
     /* Execute GLFW Window */
     UserIO::Init(window);
     glEnable(GL_DEPTH_TEST);
+
+    // The stress test and the scripted orbit measure frames as fast as they render
+    if (stressInstanceCount > 0 || orbitFrameCount > 0) { glfwSwapInterval(0); }
+    OrbitPath orbitPath(orbitFrameCount);
+    unsigned int orbitFrame = 0;
+
+    /* Time the CPU Phases of Every Frame and the Draw Pass on the GPU */
+    // The statistics cover the last 240 frames, or the whole orbit when it is longer
+    GPUTimer drawPassTimer;
+    drawPassTimer.Initialize();
+    size_t statisticsWindow = std::max<size_t>(240, orbitFrameCount);
+    FrameStatistics frameTimes(statisticsWindow);
+    FrameStatistics updateTimes(statisticsWindow);
+    FrameStatistics cullTimes(statisticsWindow);
+    FrameStatistics drawTimes(statisticsWindow);
+    FrameStatistics gpuDrawTimes(statisticsWindow);
+    auto frameStatisticsText = [&]()
+    {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(2) << "frame " << frameTimes.Average() << " ms (min " << frameTimes.Min() << ", p99 " << frameTimes.Percentile(0.99)
+             << "), CPU update " << updateTimes.Average() << " ms (cull " << cullTimes.Average() << "), CPU draw " << drawTimes.Average() << " ms, GPU draw " << gpuDrawTimes.Average() << " ms";
+        return text.str();
+    };
+    auto statisticsShownAt = std::chrono::steady_clock::now();
     while (!glfwWindowShouldClose(window))
     {        
+        Profiler::Scope frameScope(profiler, "Frame");
+        Profiler::Scope updateScope(profiler, "Update");
         glfwGetWindowSize(window, &windowWidth, &windowHeight);
         glViewport(0, 0, windowWidth, windowHeight);
         glClearColor(0, 0, 0, 1.0); 
@@ -321,6 +731,12 @@ int main(int argc, char** argv)
             if (shaderIsReady) { std::cout << "Shaders recompiled successfully" << std::endl; }
             else { std::cerr << "Failed to recompile shaders" << std::endl; glfwSetWindowShouldClose(window, true); }
             UserIO::recompileShaders = false;
+            // Rebuilding creates a new program object with new uniform locations
+            if (shaderIsReady) { program.RegisterUniforms(PROGRAM_UNIFORM_NAMES, 0, &std::cerr); }
+            for (std::vector<DrawCommand>& levelCommands : lodDrawCommands)
+            {
+                for (DrawCommand& command : levelCommands) { command.program = program.GetID(); }
+            }
         }
 
         // View Matrix
@@ -337,8 +753,6 @@ int main(int argc, char** argv)
         {
             radiusDelta = static_cast<float>(UserIO::yRelativeMousePosDelta);
         }        
-        camera.update(phiDelta, thetaDelta, radiusDelta);
-        cy::Matrix4f viewMatrix = camera.getViewMatrix();
         
         float cameraThetaDelta = 0.0f;
         float cameraPhiDelta = 0.0f;
@@ -347,50 +761,223 @@ int main(int argc, char** argv)
             cameraThetaDelta = static_cast<float>(UserIO::yRelativeMousePosDelta)*(2*cy::Pi<float>());
             cameraPhiDelta = static_cast<float>(UserIO::xRelativeMousePosDelta)*(2*cy::Pi<float>());
         }
+
+        // The scripted orbit replaces the mouse and closes the window after its last frame
+        if (orbitFrameCount > 0)
+        {
+            OrbitStep orbitStep = orbitPath.Step(orbitFrame);
+            phiDelta = orbitStep.cameraPhiDelta;
+            thetaDelta = orbitStep.cameraThetaDelta;
+            radiusDelta = orbitStep.cameraRadiusDelta;
+            cameraPhiDelta = orbitStep.lightPhiDelta;
+            cameraThetaDelta = orbitStep.lightThetaDelta;
+            if (++orbitFrame == orbitFrameCount) { glfwSetWindowShouldClose(window, true); }
+        }
+        camera.update(phiDelta, thetaDelta, radiusDelta);
+        cy::Matrix4f viewMatrix = camera.getViewMatrix();
         light.update(cameraPhiDelta, cameraThetaDelta, 0);
 
         // Perspective Matrix
         float aspect = static_cast<float>(windowWidth) / static_cast<float>(windowHeight);
         cy::Matrix4f perspectiveMatrix = cy::Matrix4f::Perspective(fovRadians, aspect, zNear, zFar);
 
-        // Final MVP Passed as Uniform Value to Shaders
-        cy::Matrix4f mvp = perspectiveMatrix * viewMatrix * modelMatrix;
-        cy::Matrix4f mv = viewMatrix * modelMatrix;
-        cy::Matrix3f mvNormal = cy::Matrix3f(viewMatrix * modelMatrix).GetInverse().GetTranspose();
+        // Pick the Triangle Under the Cursor
+        if (UserIO::pickRequested)
+        {
+            UserIO::pickRequested = false;
+            if (!meshBVHIsReady)
+            {
+                auto buildStart = std::chrono::steady_clock::now();
+                meshBVHIsReady = meshBVH.BuildFromMeshData(meshData, loadThreads);
+                auto buildEnd = std::chrono::steady_clock::now();
+                std::cout << "Built picking BVH in " << std::chrono::duration<double, std::milli>(buildEnd - buildStart).count() << " ms" << std::endl;
+                meshBVH.PrintStats(std::cout);
+            }
+
+            // Ray through the cursor in view space, then moved into the mesh space of every instance where the BVH was built.
+            // Transforms are affine, so the ray parameter t of hits in different instances can be compared directly.
+            float tanHalfFov = std::tan(fovRadians / 2);
+            float xNdc = 2.0f*static_cast<float>(UserIO::xMousePos)/windowWidth - 1.0f;
+            float yNdc = 1.0f - 2.0f*static_cast<float>(UserIO::yMousePos)/windowHeight;
+            cy::Vec3f viewDirection(xNdc*tanHalfFov*aspect, yNdc*tanHalfFov, -1);
+            RayHit hit;
+            size_t hitInstance = sceneLayout.instances.size();
+            for (size_t instance = 0; instance < sceneLayout.instances.size() && meshBVHIsReady; instance++)
+            {
+                cy::Matrix4f viewToMesh = (viewMatrix * sceneLayout.instances[instance].Matrix() * modelMatrix).GetInverse();
+                cy::Vec3f rayOrigin = cy::Vec3f(viewToMesh * cy::Vec4f(0, 0, 0, 1));
+                cy::Vec3f rayDirection = cy::Vec3f(viewToMesh * cy::Vec4f(viewDirection, 0));
+                RayHit instanceHit;
+                if (meshBVH.IntersectClosest(rayOrigin, rayDirection, instanceHit, hit.t)) { hit = instanceHit; hitInstance = instance; }
+            }
+            if (hitInstance < sceneLayout.instances.size())
+            {
+                const MeshMaterial* hitMaterial = nullptr;
+                for (size_t m = 0; m < meshData.materialCount; m++)
+                {
+                    const MeshMaterial& candidate = meshData.materials[m];
+                    if (hit.face*3 >= candidate.firstIndex && hit.face*3 < candidate.firstIndex + candidate.indexCount) { hitMaterial = &candidate; }
+                }
+                std::cout << "Picked triangle " << hit.face << " of material " << (hitMaterial ? hitMaterial->name : "none") << " on instance " << hitInstance
+                          << " at distance " << hit.t*viewDirection.Length() << " from the camera" << std::endl;
+            }
+            else { std::cout << "Picked nothing" << std::endl; }
+        }
+
+        // View, Projection, and Model Matrix Written to the Frame Uniform Buffer in One Write, the Vertex Shader Adds Each Instance Transform
+        cy::Matrix4f viewProjection = perspectiveMatrix * viewMatrix;
         cy::Vec3f lightPositionView = cy::Vec3f( viewMatrix * cy::Vec4f(light.currentPosition, 1.0) );
+        frameUniforms.Set(viewProjection, viewMatrix, modelMatrix, lightPositionView, lightIntensity, lightAmbientIntensity);
+        glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frameUniforms);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-        /* Bind Program and Uniforms then Draw */
-        program.Bind();
-        
-        program.SetUniformMatrix4("mvp", &mvp.cell[0]);
-        program.SetUniformMatrix4("mv", &mv.cell[0]);
-        program.SetUniformMatrix3("mvNormal", &mvNormal.cell[0]);
-        
-        program.SetUniform3("lightPosition", &lightPositionView[0]);
-        program.SetUniform1("lightIntensity", &lightIntensity);
-        program.SetUniform1("lightAmbientIntensity", &lightAmbientIntensity);
-        
-        texDiffuse.Bind(texDiffuseUnit);
-        program.SetUniform("mapKd", texDiffuseUnit);
-        texSpecular.Bind(texSpecularUnit);
-        program.SetUniform("mapKs", texSpecularUnit);
-        texAmbient.Bind(texAmbientUnit);
-        program.SetUniform("mapKa", texAmbientUnit);
-        
-        program.SetUniform1("mtl_Ns", &mesh.M(0).Ns);
-        program.SetUniform3("mtl_Ka", &mesh.M(0).Ka[0]);
-        program.SetUniform3("mtl_Kd", &mesh.M(0).Kd[0]);
-        program.SetUniform3("mtl_Ks", &mesh.M(0).Ks[0]);
-        
+        /* Cull the Instances Against the View Frustum and Pick Their Level of Detail */
+        if (cullInstances)
+        {
+            Profiler::Scope cullScope(profiler, "Cull");
+            lodSelection.cameraPosition = camera.currentPosition;
+            lodSelection.pixelsPerUnit = LODSelection::PixelsPerUnit(fovRadians, windowHeight);
+            frustumCuller.Cull(instanceBounds, Frustum::FromViewProjection(viewProjection), lodSelection, cullResult);
+            visibleInstances.clear();
+            for (const std::vector<uint32_t>& levelInstances : cullResult.levels)
+            {
+                for (uint32_t instance : levelInstances) { visibleInstances.push_back(sceneLayout.instances[instance]); }
+            }
+            // Orphaning the buffer lets the driver hand out new storage instead of waiting for the draws of the last frame
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            glBufferData(GL_ARRAY_BUFFER, instanceBufferBytes, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, visibleInstances.size()*sizeof(InstanceTransform), visibleInstances.data());
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            cullTimes.Add(cullScope.Stop());
+        }
+        drawList.commands.clear();
+        uint32_t levelFirstInstance = 0;
+        for (size_t level = 0; level < cullResult.levels.size(); level++)
+        {
+            uint32_t levelInstanceCount = static_cast<uint32_t>(cullResult.levels[level].size());
+            for (DrawCommand command : lodDrawCommands[level])
+            {
+                if (levelInstanceCount == 0) { continue; }
+                command.firstInstance = levelFirstInstance;
+                command.instanceCount = levelInstanceCount;
+                drawList.commands.push_back(command);
+            }
+            levelFirstInstance += levelInstanceCount;
+        }
+        drawList.Sort();
+        updateTimes.Add(updateScope.Stop());
+
+        /* Bind Program and Uniforms then Draw Every Material Range */
+        Profiler::Scope drawScope(profiler, "Draw");
+        drawPassTimer.Begin();
         glBindVertexArray(vao);
-        glDrawArrays(GL_TRIANGLES, 0, static_cast<int>(positions.size()) );
+        FrameCounters frameCounters = drawList.Submit(
+            [&](GLuint)
+            {
+                program.Bind();
+
+                program.SetUniform3(UNIFORM_POSITION_OFFSET, &vertexDecode.positionOffset[0]);
+                program.SetUniform3(UNIFORM_POSITION_SCALE, &vertexDecode.positionScale[0]);
+                program.SetUniform2(UNIFORM_UV_OFFSET, &vertexDecode.uvOffset[0]);
+                program.SetUniform2(UNIFORM_UV_SCALE, &vertexDecode.uvScale[0]);
+                program.SetUniform(UNIFORM_OCTAHEDRAL_NORMALS, vertexDecode.octahedralNormals ? 1 : 0);
+
+                program.SetUniform(UNIFORM_MAP_KD, texDiffuseUnit);
+                program.SetUniform(UNIFORM_MAP_KS, texSpecularUnit);
+                program.SetUniform(UNIFORM_MAP_KA, texAmbientUnit);
+            },
+            [&](int slot, GLuint texture)
+            {
+                glActiveTexture(GL_TEXTURE0 + textureUnits[slot]);
+                glBindTexture(GL_TEXTURE_2D, texture);
+            },
+            [&](const DrawCommand& command)
+            {
+                program.SetUniform(UNIFORM_MATERIAL_INDEX, static_cast<int>(command.materialIndex));
+                glDrawElementsInstancedBaseInstance(GL_TRIANGLES, static_cast<GLsizei>(command.indexCount), indexType, reinterpret_cast<void*>(static_cast<size_t>(command.firstIndex)*meshData.indexSize),
+                                                    static_cast<GLsizei>(command.instanceCount), command.firstInstance);
+            });
         glBindVertexArray(0);
+        drawPassTimer.End();
+        drawTimes.Add(drawScope.Stop());
 
         /* Display Final Render */
+        Profiler::Scope swapScope(profiler, "Swap Buffers");
         glfwSwapBuffers(window);
         glfwPollEvents();
+        swapScope.Stop();
+        drawPassTimer.Collect([&](double milliseconds, std::chrono::steady_clock::time_point issued)
+        {
+            gpuDrawTimes.Add(milliseconds);
+            profiler.RecordGPU("Draw", issued, milliseconds);
+        });
+        frameTimes.Add(frameScope.Stop());
+
+        // The title is updated when the counters or the visible instances change and once per second with the frame statistics,
+        // which --profile and the stress test also print
+        auto frameEnd = std::chrono::steady_clock::now();
+        bool statisticsAreDue = millisecondsBetween(statisticsShownAt, frameEnd) >= 1000.0;
+        if (frameCounters != shownFrameCounters || cullResult.VisibleCount() != shownVisibleCount || statisticsAreDue)
+        {
+            shownFrameCounters = frameCounters;
+            shownVisibleCount = cullResult.VisibleCount();
+            std::ostringstream title;
+            title << "InteractiveGraphicsProject - " << shownVisibleCount << " of " << instanceCount << " instances visible, " << frameCounters.drawCalls << " draws, " << frameCounters.StateChanges() << " state changes ("
+                  << frameCounters.programBinds << " program, " << frameCounters.textureBinds << " texture binds) | " << frameStatisticsText();
+            glfwSetWindowTitle(window, title.str().c_str());
+        }
+        if (statisticsAreDue)
+        {
+            statisticsShownAt = frameEnd;
+            if (printProfile || stressInstanceCount > 0)
+            {
+                std::cout << "Last " << frameTimes.Count() << " frames: " << frameStatisticsText() << ", " << shownVisibleCount << " of " << instanceCount << " instances visible" << std::endl;
+            }
+        }
+    }
+    if (orbitFrameCount > 0)
+    {
+        // The draw passes of the last frames are still on the GPU when the window closes
+        glFinish();
+        drawPassTimer.Collect([&](double milliseconds, std::chrono::steady_clock::time_point issued)
+        {
+            gpuDrawTimes.Add(milliseconds);
+            profiler.RecordGPU("Draw", issued, milliseconds);
+        });
+        std::cout << "Orbit of " << orbitFrame << " frames: " << frameStatisticsText() << std::endl;
+    }
+
+    /* Write the Load Times, Peak Memory, and Frame Statistics for FrameBenchmark */
+    if (!resultsFilePath.empty())
+    {
+        FrameReportMesh reportMesh;
+        reportMesh.name = objFilePath.stem().string();
+        reportMesh.width = static_cast<unsigned int>(windowWidth);
+        reportMesh.height = static_cast<unsigned int>(windowHeight);
+        reportMesh.triangleCount = meshData.indexCount / 3;
+        reportMesh.vertexCount = meshData.vertexCount;
+        reportMesh.instanceCount = instanceCount;
+        reportMesh.drawCount = lodDrawCommands[0].size();
+        reportMesh.meshMilliseconds = millisecondsBetween(startupStart, meshLoadEnd);
+        reportMesh.textureMilliseconds = millisecondsBetween(textureWaitStart, textureWaitEnd);
+        reportMesh.uploadMilliseconds = millisecondsBetween(meshUploadStart, meshUploadEnd) + millisecondsBetween(textureUploadStart, textureUploadEnd);
+        reportMesh.totalMilliseconds = millisecondsBetween(startupStart, textureUploadEnd);
+        reportMesh.peakResidentBytes = FrameReport::PeakResidentBytes();
+        reportMesh.frameTimes = frameTimes;
+        reportMesh.cpuUpdateTimes = updateTimes;
+        reportMesh.cpuDrawTimes = drawTimes;
+        reportMesh.gpuDrawTimes = gpuDrawTimes;
+        if (!FrameReport::Write(resultsFilePath, "GraphicsProject", "opengl", orbitFrame, { FrameReport::MeshJson(reportMesh) }, &std::cerr))
+        {
+            writeTrace();
+            glfwTerminate();
+            return -1;
+        }
+        std::cout << "Wrote results to " << resultsFilePath << std::endl;
     }
 
+    writeTrace();
     glfwTerminate();
     return 0;
 }
\ No newline at end of file